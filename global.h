@@ -13,6 +13,8 @@
 #include "lib_wifi.h"
 #endif
 
+// Logs text rendering times for sizes 1 to 4 at boot
+// #define FEATURE_TEXT_BENCHMARK
 #include "lib_display.h"
 #include "vm/vm.h"
 
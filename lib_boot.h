@@ -0,0 +1,78 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include "lib_log.h"
+
+#define BOOT_PHASES 16
+
+struct BootPhase
+{
+  const char *name;
+  int64_t us; // since the app started
+};
+
+/**
+ * Timestamps of the boot phases, marked by setup(), loop() and the tasks setup() starts.
+ * Each phase is kept the first time it is marked, so marks from loops cost a lookup afterwards.
+ */
+class BootProfile
+{
+private:
+  BootPhase phases[BOOT_PHASES];
+  uint8_t count = 0;
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+  void mark(const char *name)
+  {
+    int64_t now = esp_timer_get_time();
+    bool added = false;
+    portENTER_CRITICAL(&lock);
+    bool known = false;
+    for (uint8_t i = 0; i < count && !known; i++)
+    {
+      known = strcmp(phases[i].name, name) == 0;
+    }
+    if (!known && count < BOOT_PHASES)
+    {
+      phases[count++] = {name, now};
+      added = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (added)
+    {
+      LOG_INFO("Boot: %s at %lluus", name, (unsigned long long)now);
+    }
+  }
+
+  // Copies up to `size` phases in the order they were marked, returns how many
+  uint8_t snapshot(BootPhase *out, uint8_t size) const
+  {
+    portENTER_CRITICAL(&lock);
+    uint8_t n = count < size ? count : size;
+    memcpy(out, phases, n * sizeof(BootPhase));
+    portEXIT_CRITICAL(&lock);
+    return n;
+  }
+
+  void appendJson(String &out) const
+  {
+    BootPhase copy[BOOT_PHASES];
+    uint8_t n = snapshot(copy, BOOT_PHASES);
+    out += "{\"reset_reason\":" + String((int)esp_reset_reason()) + ",\"phases\":{";
+    for (uint8_t i = 0; i < n; i++)
+    {
+      out += i ? ",\"" : "\"";
+      out += copy[i].name;
+      out += "\":" + String((unsigned long)copy[i].us);
+    }
+    out += "}}";
+  }
+};
+
+BootProfile boot;
+
+#endif
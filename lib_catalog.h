@@ -0,0 +1,225 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <Arduino.h>
+#include <vector>
+#include "lib_fs.h"
+#include "lib_log.h"
+
+#define CATALOG_BLOCK_SIZE 4096 // LittleFS block, files occupy whole blocks
+#define CATALOG_LISTENERS 4
+
+struct CatalogEntry
+{
+  String path;
+  uint32_t size;
+  time_t mtime;
+};
+
+// Called after a file was written or deleted, outside the catalog lock
+typedef void (*CatalogListener)(const String &path);
+
+/**
+ * Files on LittleFS with their size and modification time, walked once at boot and then kept up to date
+ * by everything that writes or deletes files. Used bytes start from LittleFS and are then estimated per block.
+ * Shared between the web server and loop(), every access holds the mutex.
+ */
+class FileCatalog
+{
+private:
+  fs::LittleFSFS *fs = nullptr;
+  std::vector<CatalogEntry> entries;
+  size_t totalBytes = 0;
+  size_t usedBytes = 0;
+  SemaphoreHandle_t mutex = nullptr;
+  CatalogListener listeners[CATALOG_LISTENERS] = {};
+
+  void notify(const String &path)
+  {
+    for (CatalogListener listener : listeners)
+    {
+      if (listener)
+      {
+        listener(path);
+      }
+    }
+  }
+
+  static size_t blocks(uint32_t size)
+  {
+    return (size + CATALOG_BLOCK_SIZE - 1) / CATALOG_BLOCK_SIZE * CATALOG_BLOCK_SIZE;
+  }
+
+  void lock()
+  {
+    if (mutex)
+    {
+      xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+  }
+  void unlock()
+  {
+    if (mutex)
+    {
+      xSemaphoreGive(mutex);
+    }
+  }
+
+  int find(const String &path) const
+  {
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      if (entries[i].path == path)
+      {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  void walk(const char *dirname)
+  {
+    File root = fs->open(dirname);
+    if (!root || !root.isDirectory())
+    {
+      return;
+    }
+    std::vector<String> stale;
+    for (File file = root.openNextFile(); file; file = root.openNextFile())
+    {
+      if (file.isDirectory())
+      {
+        walk(file.path());
+      }
+      else if (String(file.path()).endsWith(UPLOAD_TEMP_SUFFIX))
+      {
+        stale.push_back(file.path()); // left behind by an upload that never completed
+      }
+      else
+      {
+        entries.push_back({String(file.path()), (uint32_t)file.size(), file.getLastWrite()});
+      }
+    }
+    root.close();
+    for (const String &path : stale)
+    {
+      fs->remove(path);
+      LOG_WARN("Removed incomplete upload %s", path.c_str());
+    }
+  }
+
+public:
+  void begin(fs::LittleFSFS &filesystem)
+  {
+    uint32_t start = micros();
+    fs = &filesystem;
+    if (!mutex)
+    {
+      mutex = xSemaphoreCreateMutex();
+    }
+    lock();
+    entries.clear();
+    walk("/");
+    totalBytes = fs->totalBytes();
+    usedBytes = fs->usedBytes();
+    unlock();
+    LOG_INFO("Catalog: %u files, %u of %u bytes used, built in %luus", entries.size(), usedBytes, totalBytes, micros() - start);
+  }
+
+  // Call after a file was written or replaced
+  void update(const String &path)
+  {
+    if (!fs)
+    {
+      return;
+    }
+    File file = fs->open(path);
+    if (!file || file.isDirectory())
+    {
+      remove(path);
+      return;
+    }
+    CatalogEntry entry = {String(file.path()), (uint32_t)file.size(), file.getLastWrite()};
+    file.close();
+
+    lock();
+    int index = find(entry.path);
+    if (index < 0)
+    {
+      usedBytes += blocks(entry.size);
+      entries.push_back(entry);
+    }
+    else
+    {
+      usedBytes += blocks(entry.size) - blocks(entries[index].size);
+      entries[index] = entry;
+    }
+    usedBytes = min(usedBytes, totalBytes);
+    unlock();
+    notify(entry.path);
+  }
+
+  // Call after a file was deleted
+  void remove(const String &path)
+  {
+    lock();
+    int index = find(path);
+    if (index >= 0)
+    {
+      usedBytes -= min(usedBytes, blocks(entries[index].size));
+      entries.erase(entries.begin() + index);
+    }
+    unlock();
+    notify(path);
+  }
+
+  // Copies the entry for `path`, false if there is no such file
+  bool lookup(const String &path, CatalogEntry &out)
+  {
+    lock();
+    int index = find(path);
+    if (index >= 0)
+    {
+      out = entries[index];
+    }
+    unlock();
+    return index >= 0;
+  }
+
+  // Returns false once all slots are taken
+  bool onChange(CatalogListener listener)
+  {
+    for (CatalogListener &slot : listeners)
+    {
+      if (!slot)
+      {
+        slot = listener;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Calls `callback` with entry `index` while the catalog is locked, false if there is no such entry
+  template <typename Callback>
+  bool with(size_t index, Callback callback)
+  {
+    lock();
+    bool found = index < entries.size();
+    if (found)
+    {
+      callback(entries[index]);
+    }
+    unlock();
+    return found;
+  }
+
+  size_t size() const { return entries.size(); }
+  size_t total() const { return totalBytes; }
+  size_t used() const { return usedBytes; }
+  size_t freeBytes() const { return totalBytes - usedBytes; }
+};
+
+FileCatalog catalog;
+
+#endif
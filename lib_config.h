@@ -0,0 +1,242 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <Arduino.h>
+#include "lib_catalog.h"
+#include "lib_fs.h"
+#include "lib_log.h"
+
+#define CONFIG_LISTENERS 4
+
+enum class ConfigType : uint8_t
+{
+  STRING,
+  INT,
+};
+
+struct ConfigEntry
+{
+  const char *key; // stored in /<key>, first line only
+  ConfigType type;
+  const char *fallback;
+  long min;
+  long max;
+  String value;
+  long number;
+};
+
+// Called from the task that changed the value, after it was written
+typedef void (*ConfigListener)(const char *key);
+
+/**
+ * Settings kept in RAM, loaded from their files once at boot.
+ * set() validates, writes through to flash and notifies the listeners, unchanged values are not written.
+ * Files replaced behind its back (uploads, deletes) are picked up with reload().
+ */
+class ConfigStore
+{
+private:
+  fs::FS *fs = nullptr;
+  ConfigEntry entries[3] = {
+      {"background", ConfigType::STRING, "", 0, 0, "", 0},
+      {"playlist", ConfigType::STRING, "", 0, 0, "", 0}, // shown instead of the background while set
+      {"offset", ConfigType::INT, "2", -19, 19, "", 0},  // hours from UTC
+  };
+  ConfigListener listeners[CONFIG_LISTENERS] = {};
+  SemaphoreHandle_t mutex = nullptr;
+
+  void lock()
+  {
+    if (mutex)
+    {
+      xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+  }
+  void unlock()
+  {
+    if (mutex)
+    {
+      xSemaphoreGive(mutex);
+    }
+  }
+
+  // Accepts "offset" as well as "/offset"
+  ConfigEntry *find(const char *key)
+  {
+    key += key[0] == '/';
+    for (ConfigEntry &entry : entries)
+    {
+      if (strcmp(entry.key, key) == 0)
+      {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool parse(const ConfigEntry &entry, const String &text, long &number)
+  {
+    number = 0;
+    if (entry.type == ConfigType::STRING)
+    {
+      return true;
+    }
+    char *end;
+    number = strtol(text.c_str(), &end, 10);
+    return !text.isEmpty() && *end == '\0' && entry.min <= number && number <= entry.max;
+  }
+
+  // Returns true if the value changed, the caller holds the lock
+  static bool apply(ConfigEntry &entry, const String &text, long number)
+  {
+    if (entry.value == text)
+    {
+      return false;
+    }
+    entry.value = text;
+    entry.number = number;
+    return true;
+  }
+
+  String path(const ConfigEntry &entry) const
+  {
+    return String("/") + entry.key;
+  }
+
+  // File content, or the fallback if it is missing or invalid
+  void load(ConfigEntry &entry, String &text, long &number)
+  {
+    text = "";
+    readFileToString(*fs, path(entry).c_str(), text);
+    text.trim(); // "5\r\n" from an editor, as String::toInt() used to accept
+    if (!text.isEmpty() && !parse(entry, text, number))
+    {
+      LOG_WARN("Invalid %s value: %s", entry.key, text.c_str());
+      text = "";
+    }
+    if (text.isEmpty())
+    {
+      text = entry.fallback;
+      parse(entry, text, number);
+    }
+  }
+
+  void notify(const char *key)
+  {
+    for (ConfigListener listener : listeners)
+    {
+      if (listener)
+      {
+        listener(key);
+      }
+    }
+  }
+
+public:
+  void begin(fs::FS &filesystem)
+  {
+    uint32_t start = micros();
+    fs = &filesystem;
+    if (!mutex)
+    {
+      mutex = xSemaphoreCreateMutex();
+    }
+    lock();
+    for (ConfigEntry &entry : entries)
+    {
+      String text;
+      long number;
+      load(entry, text, number);
+      apply(entry, text, number);
+    }
+    unlock();
+    LOG_INFO("Config loaded in %luus", micros() - start);
+  }
+
+  bool contains(const char *key)
+  {
+    return find(key) != nullptr;
+  }
+
+  // False for unknown keys and invalid values, nothing is written then. Surrounding whitespace is dropped.
+  bool set(const char *key, String value)
+  {
+    ConfigEntry *entry = find(key);
+    long number;
+    value.trim();
+    if (!entry || !fs || !parse(*entry, value, number))
+    {
+      return false;
+    }
+    lock();
+    bool changed = apply(*entry, value, number);
+    if (changed)
+    {
+      writeFile(*fs, path(*entry).c_str(), value.c_str());
+    }
+    unlock();
+    if (changed)
+    {
+      catalog.update(path(*entry));
+      notify(entry->key);
+    }
+    return true;
+  }
+
+  // Call after the file of a key was replaced or deleted without set()
+  void reload(const char *key)
+  {
+    ConfigEntry *entry = find(key);
+    if (!entry || !fs)
+    {
+      return;
+    }
+    String text;
+    long number;
+    lock();
+    load(*entry, text, number);
+    bool changed = apply(*entry, text, number);
+    unlock();
+    if (changed)
+    {
+      notify(entry->key);
+    }
+  }
+
+  String getString(const char *key)
+  {
+    ConfigEntry *entry = find(key);
+    if (!entry)
+    {
+      return String();
+    }
+    lock();
+    String value = entry->value;
+    unlock();
+    return value;
+  }
+
+  long getInt(const char *key)
+  {
+    ConfigEntry *entry = find(key);
+    return entry ? entry->number : 0;
+  }
+
+  // Returns false once all slots are taken
+  bool onChange(ConfigListener listener)
+  {
+    for (ConfigListener &slot : listeners)
+    {
+      if (!slot)
+      {
+        slot = listener;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+ConfigStore config;
+
+#endif
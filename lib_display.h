@@ -1,7 +1,11 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include "lib_catalog.h"
+#include "lib_framecache.h"
 #include "lib_fs.h"
+#include "lib_image.h"
+#include "lib_framebuffer.h"
 
 #include <Adafruit_GFX.h>    // Core graphics library
 #include <Adafruit_ST7789.h> // Hardware-specific library for ST7789
@@ -16,15 +20,121 @@
 #define TFT_SEGMENTS 5
 #define TFT_PIXELS TFT_WIDTH *TFT_HEIGHT
 #define TFT_DRAW_SECTION TFT_PIXELS / TFT_SEGMENTS
+#define TFT_SEGMENT_HEIGHT (TFT_HEIGHT / TFT_SEGMENTS)
+#define TFT_BLIT_CORE 0 // loop() runs on core 1, push pixels from the other one
 Adafruit_ST7789 tft = Adafruit_ST7789(TFT_CS, TFT_DC, TFT_RST);
-uint16_t tft_buffer[TFT_DRAW_SECTION];
+FrameBuffer display(tft, TFT_WIDTH, TFT_HEIGHT, TFT_SEGMENTS); // VM drawing goes here, pushed with display.flushDamage()
+uint16_t tft_buffer[2][TFT_DRAW_SECTION]; // ping-pong: one is read from flash while the other is sent over SPI
 
-const char *files[] = {
-    // "/red.raw",
-    //  "/green.raw",
-    // "/blue.raw",
-    "/test.raw",
-    "/moveit.raw"};
+struct BlitJob
+{
+  int16_t x, y, w, h;
+  uint16_t *pixels;
+  bool big_endian;
+  uint32_t push_us;
+};
+SemaphoreHandle_t display_mutex = nullptr;
+QueueHandle_t blit_jobs = nullptr;
+QueueHandle_t blit_done = nullptr;
+uint32_t blit_sync_push_us = 0;
+
+// Held while a task talks to the panel: loop() drawing and the web server streaming pixels share the SPI bus
+class DisplayLock
+{
+public:
+  DisplayLock()
+  {
+    if (display_mutex)
+    {
+      xSemaphoreTakeRecursive(display_mutex, portMAX_DELAY);
+    }
+  }
+  ~DisplayLock()
+  {
+    if (display_mutex)
+    {
+      xSemaphoreGiveRecursive(display_mutex);
+    }
+  }
+};
+
+// Streams pixels into a single address window, big endian data goes to SPI without a swap pass
+void display_push_pixels(int16_t x, int16_t y, uint16_t *pixels, int16_t w, int16_t h, bool bigEndian)
+{
+  tft.startWrite();
+  tft.setAddrWindow(x, y, w, h);
+  tft.writePixels(pixels, (uint32_t)w * h, true, bigEndian);
+  tft.endWrite();
+}
+
+void display_blit_task(void *)
+{
+  BlitJob job;
+  for (;;)
+  {
+    if (xQueueReceive(blit_jobs, &job, portMAX_DELAY) == pdTRUE)
+    {
+      uint32_t start = micros();
+      display_push_pixels(job.x, job.y, job.pixels, job.w, job.h, job.big_endian);
+      job.push_us = micros() - start;
+      xQueueSend(blit_done, &job, portMAX_DELAY);
+    }
+  }
+}
+
+void display_blit_begin()
+{
+  blit_jobs = xQueueCreate(1, sizeof(BlitJob));
+  blit_done = xQueueCreate(2, sizeof(BlitJob));
+  if (!blit_jobs || !blit_done ||
+      xTaskCreatePinnedToCore(display_blit_task, "blit", 4096, nullptr, 2, nullptr, TFT_BLIT_CORE) != pdPASS)
+  {
+    Serial.println(F("Blit task not available, pushing pixels synchronously"));
+    blit_jobs = nullptr;
+    blit_done = nullptr;
+  }
+}
+
+// Hands the pixels to the blit task, the buffer must not be touched until display_blit_wait() returned it
+void display_blit_submit(int16_t x, int16_t y, uint16_t *pixels, int16_t w, int16_t h, bool bigEndian)
+{
+  BlitJob job = {x, y, w, h, pixels, bigEndian, 0};
+  if (blit_jobs)
+  {
+    xQueueSend(blit_jobs, &job, portMAX_DELAY);
+  }
+  else
+  {
+    uint32_t start = micros();
+    display_push_pixels(x, y, pixels, w, h, bigEndian);
+    blit_sync_push_us = micros() - start;
+  }
+}
+
+// Blocks until the oldest submitted job has been pushed, returns its SPI time
+uint32_t display_blit_wait()
+{
+  BlitJob job;
+  if (blit_done && xQueueReceive(blit_done, &job, portMAX_DELAY) == pdTRUE)
+  {
+    return job.push_us;
+  }
+  return blit_sync_push_us;
+}
+
+// Uploads, writes and deletes drop the cached frame of the file
+void display_frame_cache_evict(const String &path)
+{
+  frame_cache.lock();
+  frame_cache.evict(path);
+  frame_cache.unlock();
+}
+
+// Runs before wifi_begin(): FrameBuffer::begin() checks the free heap, the WiFi driver's buffers would eat into it
+void display_allocate()
+{
+  display.begin();
+}
 
 void display_setup() {
   pinMode(LCD_BLK, OUTPUT);
@@ -32,6 +142,11 @@ void display_setup() {
 
   tft.init(TFT_HEIGHT, TFT_WIDTH, SPI_MODE2);
   tft.setRotation(3);
+
+  display_mutex = xSemaphoreCreateRecursiveMutex();
+  display_blit_begin();
+  frame_cache.begin();
+  catalog.onChange(display_frame_cache_evict);
 }
 
 void display_brightness_set(uint8_t brightness)
@@ -64,49 +179,265 @@ void display_brightness_fadeOut(uint8_t brightness, int delay_ms)
 }
 
 #define DISPLAY_STEP_MS 50
-void delay_display(int ms)
+// Shows a progress bar while waiting, `wait` may return true to end the delay early
+bool delay_display(int ms, bool (*wait)(uint32_t ms))
 {
-  tft.drawFastHLine(0, TFT_HEIGHT - 1, TFT_WIDTH, ST77XX_BLUE);
+  {
+    DisplayLock lock;
+    tft.drawFastHLine(0, TFT_HEIGHT - 1, TFT_WIDTH, ST77XX_BLUE);
+  }
   for (int i = 0; i < ms; i+= DISPLAY_STEP_MS)
   {
-    tft.drawFastHLine(0, TFT_HEIGHT - 1, TFT_WIDTH * i / ms, ST77XX_RED);
-    delay(DISPLAY_STEP_MS);
+    {
+      DisplayLock lock;
+      tft.drawFastHLine(0, TFT_HEIGHT - 1, TFT_WIDTH * i / ms, ST77XX_RED);
+    }
+    if (wait(min(DISPLAY_STEP_MS, ms - i)))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void delay_display(int ms)
+{
+  delay_display(ms, [](uint32_t step)
+                {
+    delay(step);
+    return false; });
+}
+
+struct FrameTiming
+{
+  uint32_t open_us;
+  uint32_t read_us;
+  uint32_t swap_us;
+  uint32_t push_us;
+  uint32_t total_us;
+  uint32_t flash_bytes;
+  uint8_t cached_segments; // drawn straight from the frame cache
+};
+FrameTiming display_frame_timing;
+
+// Opens `path` and works out how the pixels go to the panel, false if it cannot be drawn
+bool display_picture_open(ImageReader &reader, const String &path, bool &bgr, bool &bigEndian)
+{
+  if (!reader.begin(SPIFFS, path.c_str(), TFT_WIDTH, TFT_HEIGHT))
+  {
+    return false;
+  }
+  if (reader.width() == 0 || reader.width() > TFT_WIDTH || reader.height() > TFT_HEIGHT)
+  {
+    LOG_WARN("Image %s does not fit the display: %ux%u", path.c_str(), reader.width(), reader.height());
+    return false;
   }
+  // Pixels are sent in file byte order, only BGR images need a CPU pass
+  bgr = reader.flags() & IMAGE_FLAG_BGR;
+  bigEndian = bgr ? false : reader.bigEndian();
+  return true;
 }
 
 void display_picture(String path)
 {
-  if (path.length() > 0 && SPIFFS.exists(path))
+  DisplayLock lock;
+  CatalogEntry file;
+  if (path.length() > 0 && catalog.lookup(path, file))
   {
-    for (uint16_t i = 0; i < TFT_SEGMENTS; i++)
+    FrameTiming timing = {};
+    uint32_t start = micros();
+
+    // Held until every segment was pushed, the pixels may come from the cache
+    frame_cache.lock();
+    CachedFrame *frame = frame_cache.find(path, file.mtime);
+    bool fromCache = frame != nullptr;
+    ImageReader reader;
+    bool opened = false;
+    bool bgr = false;
+    bool bigEndian;
+    uint16_t width, height;
+    if (fromCache)
+    {
+      width = frame->width;
+      height = frame->height;
+      bigEndian = frame->bigEndian;
+    }
+    else
+    {
+      opened = display_picture_open(reader, path, bgr, bigEndian);
+      if (!opened)
+      {
+        frame_cache.unlock();
+        return;
+      }
+      width = reader.width();
+      height = reader.height();
+    }
+    uint16_t rows = TFT_DRAW_SECTION / width;
+    uint16_t segments = (height + rows - 1) / rows;
+    if (!fromCache)
+    {
+      frame = frame_cache.insert(path, file.mtime, width, height, rows, bigEndian);
+    }
+    uint32_t now = micros();
+    timing.open_us = now - start;
+    bool filled = true;
+
+    // Segment i+1 is read while segment i is pushed by the blit task
+    for (uint16_t i = 0; i <= segments; i++)
+    {
+      uint16_t y = i * rows;
+      uint16_t h = height - y < rows ? height - y : rows;
+      if (i < segments)
+      {
+        uint16_t *buffer;
+        bool cachedSegment = frame && i < frame->cached;
+        if (fromCache && cachedSegment)
+        {
+          buffer = frame->pixels[i];
+          timing.cached_segments++;
+        }
+        else
+        {
+          if (!opened)
+          {
+            // Only the leading segments were cached, continue from flash
+            uint32_t t = micros();
+            opened = display_picture_open(reader, path, bgr, bigEndian) && reader.skip((uint32_t)width * y) == (uint32_t)width * y;
+            timing.open_us += micros() - t;
+          }
+          // Filled once on a miss, then served from the cache
+          buffer = cachedSegment ? frame->pixels[i] : tft_buffer[i % 2];
+          uint32_t length = (uint32_t)width * h;
+
+          uint32_t t = micros();
+          if (!opened || reader.read(buffer, length) != length)
+          {
+            // The file went away or was cut short, leave the rest of the screen as it is instead of pushing a stale buffer
+            LOG_WARN("Image %s unreadable from row %u", path.c_str(), y);
+            filled = false;
+            if (i > 0)
+            {
+              timing.push_us += display_blit_wait();
+            }
+            break;
+          }
+          now = micros();
+          timing.read_us += now - t;
+
+          if (bgr)
+          {
+            t = now;
+            rgb565_from_bgr(buffer, length, reader.bigEndian());
+            timing.swap_us += micros() - t;
+          }
+        }
+        display.mirror(0, y, buffer, width, h, bigEndian);
+      }
+      if (i > 0)
+      {
+        timing.push_us += display_blit_wait();
+      }
+      if (i < segments)
+      {
+        display_blit_submit(0, y, frame && i < frame->cached ? frame->pixels[i] : tft_buffer[i % 2], width, h, bigEndian);
+      }
+    }
+    if (frame && !fromCache)
     {
-      readRGB565File(SPIFFS, path.c_str(), tft_buffer, TFT_DRAW_SECTION, i * TFT_WIDTH * (TFT_HEIGHT / TFT_SEGMENTS));
-      tft.drawRGBBitmap(0, i * (TFT_HEIGHT / TFT_SEGMENTS), tft_buffer, TFT_WIDTH, TFT_HEIGHT / TFT_SEGMENTS);
+      frame_cache.finish(frame, filled);
     }
+    frame_cache.unlock();
+    timing.flash_bytes = opened ? reader.flashBytes() : 0;
+    reader.end();
+
+    timing.total_us = micros() - start;
+    display_frame_timing = timing;
+    metrics.frame.observe(timing.total_us);
+    LOG_INFO("Frame %s: cached=%u/%u flash=%u bytes open=%uus read=%uus swap=%uus push=%uus total=%uus",
+             path.c_str(), timing.cached_segments, segments, timing.flash_bytes, timing.open_us, timing.read_us, timing.swap_us, timing.push_us, timing.total_us);
   }
   else
   {
-    tft.fillScreen(ST77XX_BLACK);
+    display.fillScreen(ST77XX_BLACK);
+    display.flushDamage();
   }
 }
 
-void loop_display_pictures()
+// One line of text per size, glyph by glyph through Adafruit GFX, batched, and batched from the glyph cache
+void display_text_benchmark()
 {
-  for (int file_index = 0; file_index < sizeof(files) / sizeof(files[0]); file_index++)
+  static const char line[] = "Hello Handsome! 0123456789";
+  for (uint8_t size = 1; size <= 4; size++)
   {
-    display_picture(String(files[file_index]));
-
-    tft.setTextColor(ST77XX_WHITE);
+    tft.setTextColor(ST77XX_WHITE, ST77XX_BLACK);
+    tft.setTextSize(size);
     tft.setCursor(0, 0);
-    tft.setTextSize(1);
-    tft.println(F("Hello Handsome!"));
-    tft.setTextSize(2);
-    tft.println(F("Time to"));
-    tft.setTextSize(3);
-    tft.println(F(" Move it, Move it"));
+    uint32_t start = micros();
+    tft.print(line);
+    uint32_t glyphs = micros() - start;
+
+    uint32_t batched[2];
+    for (uint8_t run = 0; run < 2; run++)
+    {
+      display.setTextColor(ST77XX_WHITE, ST77XX_BLACK);
+      display.setTextSize(size);
+      display.setCursor(0, 0);
+      start = micros();
+      display.print(line);
+      display.flushDamage();
+      batched[run] = micros() - start;
+    }
+    Serial.printf("Text size %u: glyphs=%uus batched=%uus cached=%uus\n", size, glyphs, batched[0], batched[1]);
+  }
+  Serial.printf("Glyph cache: %u bytes, %u hits, %u misses\n",
+                display.glyphCache().bytes(), display.glyphCache().hits(), display.glyphCache().misses());
+}
+
+// Decodes the cacheable segments of `path` into the frame cache without drawing, false if nothing was cached
+bool display_prefetch(const String &path)
+{
+  CatalogEntry file;
+  if (path.length() == 0 || !catalog.lookup(path, file))
+  {
+    return false;
+  }
+  frame_cache.lock();
+  bool cached = frame_cache.contains(path, file.mtime);
+  frame_cache.unlock();
+  ImageReader reader;
+  bool bgr, bigEndian;
+  if (cached || !display_picture_open(reader, path, bgr, bigEndian))
+  {
+    return cached;
+  }
 
-    delay_display(1000);
+  // The lock is only held to reserve and to publish the entry, draws and evictions do not wait for the decode
+  uint16_t rows = TFT_DRAW_SECTION / reader.width();
+  frame_cache.lock();
+  CachedFrame *frame = frame_cache.reserve(path, file.mtime, reader.width(), reader.height(), rows, bigEndian);
+  frame_cache.unlock();
+  if (!frame)
+  {
+    return false;
+  }
+  cached = true;
+  for (uint8_t i = 0; i < frame->cached && cached; i++)
+  {
+    uint16_t y = i * rows;
+    uint16_t h = reader.height() - y < rows ? reader.height() - y : rows;
+    uint32_t length = (uint32_t)reader.width() * h;
+    cached = reader.read(frame->pixels[i], length) == length;
+    if (cached && bgr)
+    {
+      rgb565_from_bgr(frame->pixels[i], length, reader.bigEndian());
+    }
   }
+  frame_cache.lock();
+  cached = cached && !frame->stale;
+  frame_cache.finish(frame, cached);
+  frame_cache.unlock();
+  return cached;
 }
 
 #endif
@@ -0,0 +1,433 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <Adafruit_GFX.h>
+#include <Adafruit_ST7789.h>
+#include <Esp.h>
+#include "lib_log.h"
+#include "lib_text.h"
+
+#define FRAMEBUFFER_MAX_RECTS 8
+#define FRAMEBUFFER_HEAP_RESERVE (96 * 1024) // keep enough heap for WiFi and the web server
+
+struct DamageRect
+{
+  int16_t x, y, w, h;
+
+  int32_t area() const { return (int32_t)w * h; }
+  bool contains(const DamageRect &r) const
+  {
+    return r.x >= x && r.y >= y && r.x + r.w <= x + w && r.y + r.h <= y + h;
+  }
+  // Overlapping or directly adjacent rectangles are merged into one window
+  bool touches(const DamageRect &r) const
+  {
+    return r.x <= x + w && x <= r.x + r.w && r.y <= y + h && y <= r.y + r.h;
+  }
+  DamageRect merged(const DamageRect &r) const
+  {
+    int16_t x0 = min(x, r.x);
+    int16_t y0 = min(y, r.y);
+    int16_t x1 = max(x + w, r.x + r.w);
+    int16_t y1 = max(y + h, r.y + r.h);
+    return {x0, y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0)};
+  }
+};
+
+class DamageTracker
+{
+private:
+  DamageRect rects[FRAMEBUFFER_MAX_RECTS];
+  uint8_t count;
+
+public:
+  DamageTracker() : count(0) {}
+
+  void add(DamageRect r)
+  {
+    // Text is drawn pixel by pixel, most additions land in the rectangle touched last
+    if (count > 0 && rects[count - 1].contains(r))
+    {
+      return;
+    }
+
+    for (uint8_t i = 0; i < count;)
+    {
+      if (rects[i].touches(r))
+      {
+        r = rects[i].merged(r);
+        rects[i] = rects[--count];
+        i = 0;
+      }
+      else
+      {
+        i++;
+      }
+    }
+
+    if (count == FRAMEBUFFER_MAX_RECTS)
+    {
+      uint8_t best = 0;
+      int32_t bestGrowth = INT32_MAX;
+      for (uint8_t i = 0; i < count; i++)
+      {
+        int32_t growth = rects[i].merged(r).area() - rects[i].area();
+        if (growth < bestGrowth)
+        {
+          best = i;
+          bestGrowth = growth;
+        }
+      }
+      r = rects[best].merged(r);
+      rects[best] = rects[--count];
+    }
+    rects[count++] = r;
+  }
+
+  uint8_t size() const { return count; }
+  const DamageRect &operator[](uint8_t i) const { return rects[i]; }
+  void clear() { count = 0; }
+};
+
+/**
+ * RAM copy of the panel. Drawing only marks damaged rectangles, flushDamage() sends each of them
+ * through a single address window. Pixels are kept big endian so they go to SPI unswapped.
+ * Without enough heap every call is forwarded to the panel directly.
+ */
+class FrameBuffer : public Adafruit_GFX
+{
+private:
+  Adafruit_SPITFT &panel;
+  uint16_t *bands[8];
+  uint8_t bandCount; // 0 until begin() allocated the bands
+  uint8_t requestedBands;
+  int16_t bandHeight;
+  DamageTracker damage;
+  GlyphCache glyphs;
+
+  uint32_t lastFlushBytes;
+  uint32_t totalFlushBytes;
+  uint32_t flushCount;
+  uint32_t changes;
+
+  uint16_t *row(int16_t y) const
+  {
+    return bands[y / bandHeight] + (y % bandHeight) * WIDTH;
+  }
+
+  bool clip(int16_t &x, int16_t &y, int16_t &w, int16_t &h) const
+  {
+    if (x < 0)
+    {
+      w += x;
+      x = 0;
+    }
+    if (y < 0)
+    {
+      h += y;
+      y = 0;
+    }
+    if (x + w > WIDTH)
+    {
+      w = WIDTH - x;
+    }
+    if (y + h > HEIGHT)
+    {
+      h = HEIGHT - y;
+    }
+    return w > 0 && h > 0;
+  }
+
+  // Opaque text can always be batched, transparent text only on top of the buffered pixels
+  bool canBatchText() const
+  {
+    return !gfxFont && (isBuffered() || textbgcolor != textcolor);
+  }
+
+  /**
+   * Rasterizes a run of characters on one line. Buffered, the run lands in the bands as a single damaged
+   * rectangle; otherwise it is composed in a temporary line buffer and sent through one address window.
+   */
+  void drawTextRun(const uint8_t *text, size_t length, int16_t x, int16_t y)
+  {
+    int16_t glyphW = TEXT_GLYPH_WIDTH * textsize_x;
+    int16_t glyphH = TEXT_GLYPH_HEIGHT * textsize_y;
+    int16_t rx = x, ry = y, rw = length * glyphW, rh = glyphH;
+    if (!clip(rx, ry, rw, rh))
+    {
+      return;
+    }
+
+    bool opaque = textbgcolor != textcolor;
+    uint16_t fg = __builtin_bswap16(textcolor);
+    uint16_t bg = __builtin_bswap16(textbgcolor);
+    uint16_t *line = nullptr;
+    if (!isBuffered())
+    {
+      line = (uint16_t *)malloc((size_t)rw * rh * sizeof(uint16_t));
+      if (!line)
+      {
+        for (size_t k = 0; k < length; k++)
+        {
+          drawChar(x + k * glyphW, y, text[k], textcolor, textbgcolor, textsize_x, textsize_y);
+        }
+        return;
+      }
+    }
+
+    for (size_t k = 0; k < length; k++)
+    {
+      int16_t gx = x + k * glyphW;
+      int16_t x0 = max(gx, rx);
+      int16_t x1 = min<int16_t>(gx + glyphW, rx + rw);
+      if (x0 >= x1)
+      {
+        continue;
+      }
+      uint8_t c = text[k];
+      if (!_cp437 && c >= 176)
+      {
+        c++; // same mapping as Adafruit_GFX::drawChar()
+      }
+
+      const uint16_t *block = opaque ? glyphs.get(c, textsize_x, textsize_y, fg, bg) : nullptr;
+      for (int16_t j = ry; j < ry + rh; j++)
+      {
+        uint16_t *dst = line ? line + (int32_t)(j - ry) * rw + (x0 - rx) : row(j) + x0;
+        if (block)
+        {
+          memcpy(dst, block + (j - y) * glyphW + (x0 - gx), (x1 - x0) * sizeof(uint16_t));
+          continue;
+        }
+        uint8_t bit = 1 << ((j - y) / textsize_y);
+        for (int16_t i = x0; i < x1; i++, dst++)
+        {
+          if (text_font_column(c, (i - gx) / textsize_x) & bit)
+          {
+            *dst = fg;
+          }
+          else if (opaque)
+          {
+            *dst = bg;
+          }
+        }
+      }
+    }
+
+    if (line)
+    {
+      panel.startWrite();
+      panel.setAddrWindow(rx, ry, rw, rh);
+      panel.writePixels(line, (uint32_t)rw * rh, true, true);
+      panel.endWrite();
+      free(line);
+      changes++;
+    }
+    else
+    {
+      damage.add({rx, ry, rw, rh});
+    }
+  }
+
+public:
+  FrameBuffer(Adafruit_SPITFT &panel, int16_t w, int16_t h, uint8_t bands)
+      : Adafruit_GFX(w, h), panel(panel), bandCount(0), requestedBands(bands), bandHeight((h + bands - 1) / bands),
+        lastFlushBytes(0), totalFlushBytes(0), flushCount(0), changes(0)
+  {
+    memset(this->bands, 0, sizeof(this->bands));
+  }
+
+  bool begin()
+  {
+    size_t bandBytes = (size_t)bandHeight * WIDTH * sizeof(uint16_t);
+    if (requestedBands > sizeof(bands) / sizeof(bands[0]) || ESP.getFreeHeap() < bandBytes * requestedBands + FRAMEBUFFER_HEAP_RESERVE)
+    {
+      Serial.println(F("Not enough heap for a framebuffer, drawing directly"));
+      return false;
+    }
+    for (uint8_t i = 0; i < requestedBands; i++)
+    {
+      bands[i] = (uint16_t *)calloc(bandHeight * WIDTH, sizeof(uint16_t));
+      if (!bands[i])
+      {
+        Serial.println(F("Framebuffer allocation failed, drawing directly"));
+        for (uint8_t j = 0; j < i; j++)
+        {
+          free(bands[j]);
+          bands[j] = nullptr;
+        }
+        return false;
+      }
+    }
+    bandCount = requestedBands;
+    return true;
+  }
+
+  bool isBuffered() const { return bandCount > 0; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override
+  {
+    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT)
+    {
+      return;
+    }
+    if (!isBuffered())
+    {
+      panel.drawPixel(x, y, color);
+      changes++;
+      return;
+    }
+    row(y)[x] = __builtin_bswap16(color);
+    damage.add({x, y, 1, 1});
+  }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override
+  {
+    if (!clip(x, y, w, h))
+    {
+      return;
+    }
+    if (!isBuffered())
+    {
+      panel.fillRect(x, y, w, h, color);
+      changes++;
+      return;
+    }
+    uint16_t value = __builtin_bswap16(color);
+    for (int16_t j = y; j < y + h; j++)
+    {
+      uint16_t *p = row(j) + x;
+      for (int16_t i = 0; i < w; i++)
+      {
+        p[i] = value;
+      }
+    }
+    damage.add({x, y, w, h});
+  }
+
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override
+  {
+    fillRect(x, y, w, 1, color);
+  }
+
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override
+  {
+    fillRect(x, y, 1, h, color);
+  }
+
+  void fillScreen(uint16_t color) override
+  {
+    fillRect(0, 0, WIDTH, HEIGHT, color);
+  }
+
+  using Print::write;
+
+  size_t write(uint8_t c) override
+  {
+    return write(&c, 1);
+  }
+
+  // Same cursor, wrap and newline handling as Adafruit_GFX::write(), but whole runs of glyphs per call
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    if (!canBatchText())
+    {
+      for (size_t i = 0; i < size; i++)
+      {
+        Adafruit_GFX::write(buffer[i]);
+      }
+      return size;
+    }
+
+    int16_t glyphW = TEXT_GLYPH_WIDTH * textsize_x;
+    for (size_t i = 0; i < size;)
+    {
+      if (buffer[i] == '\n')
+      {
+        cursor_x = 0;
+        cursor_y += TEXT_GLYPH_HEIGHT * textsize_y;
+        i++;
+        continue;
+      }
+      if (buffer[i] == '\r')
+      {
+        i++;
+        continue;
+      }
+      if (wrap && cursor_x + glyphW > _width)
+      {
+        cursor_x = 0;
+        cursor_y += TEXT_GLYPH_HEIGHT * textsize_y;
+      }
+
+      // At least one glyph per run, even if it is wider than the screen
+      size_t start = i++;
+      int16_t end = cursor_x + glyphW;
+      while (i < size && buffer[i] != '\n' && buffer[i] != '\r' && !(wrap && end + glyphW > _width))
+      {
+        end += glyphW;
+        i++;
+      }
+      drawTextRun(buffer + start, i - start, cursor_x, cursor_y);
+      cursor_x = end;
+    }
+    return size;
+  }
+
+  // Records pixels that were already sent to the panel, e.g. by display_picture()
+  // `changed` false keeps generation() as is, so loop() does not paint the background over them
+  void mirror(int16_t x, int16_t y, const uint16_t *pixels, int16_t w, int16_t h, bool bigEndian, bool changed = true)
+  {
+    if (!isBuffered() || x < 0 || y < 0 || x + w > WIDTH || y + h > HEIGHT)
+    {
+      return;
+    }
+    for (int16_t j = 0; j < h; j++)
+    {
+      uint16_t *p = row(y + j) + x;
+      const uint16_t *src = pixels + (int32_t)j * w;
+      for (int16_t i = 0; i < w; i++)
+      {
+        p[i] = bigEndian ? src[i] : __builtin_bswap16(src[i]);
+      }
+    }
+    changes += changed;
+  }
+
+  // Sends all damaged rectangles to the panel, returns the number of pixel bytes pushed
+  uint32_t flushDamage()
+  {
+    uint32_t bytes = 0;
+    if (damage.size() > 0)
+    {
+      panel.startWrite();
+      for (uint8_t i = 0; i < damage.size(); i++)
+      {
+        const DamageRect &r = damage[i];
+        panel.setAddrWindow(r.x, r.y, r.w, r.h);
+        for (int16_t j = r.y; j < r.y + r.h; j++)
+        {
+          panel.writePixels(row(j) + r.x, r.w, true, true);
+        }
+        bytes += r.area() * sizeof(uint16_t);
+      }
+      panel.endWrite();
+      LOG_DEBUG("Display flush: %u rects, %u bytes", damage.size(), bytes);
+      damage.clear();
+      changes++;
+    }
+    lastFlushBytes = bytes;
+    totalFlushBytes += bytes;
+    flushCount++;
+    return bytes;
+  }
+
+  const GlyphCache &glyphCache() const { return glyphs; }
+  uint32_t lastFlush() const { return lastFlushBytes; }
+  uint32_t totalFlushed() const { return totalFlushBytes; }
+  uint32_t flushes() const { return flushCount; }
+  // Increases whenever the panel content changed through this layer
+  uint32_t generation() const { return changes; }
+};
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "lib_log.h"
+
+#define FRAME_CACHE_ENTRIES 8
+#define FRAME_CACHE_SEGMENTS 8                      // per frame, later segments are always read from flash
+#define FRAME_CACHE_PSRAM_BUDGET (2 * 1024 * 1024)  // bytes, used when PSRAM is found
+#define FRAME_CACHE_HEAP_BUDGET (64 * 1024)         // bytes of internal heap otherwise, 0 disables the cache
+#define FRAME_CACHE_HEAP_RESERVE (48 * 1024)        // internal heap left free for everything else
+
+// Panel-ready pixels of the first `cached` segments of an image, in the byte order given by bigEndian
+struct CachedFrame
+{
+  String path;
+  time_t mtime;
+  uint16_t width;
+  uint16_t height;
+  uint16_t rows; // per segment
+  uint8_t segments;
+  uint8_t cached;
+  bool bigEndian;
+  bool complete; // false until the first draw filled every cached segment
+  bool filling;  // reserved by a reader that fills it without holding the lock, see reserve()
+  bool stale;    // evicted while filling, finish() frees it
+  uint32_t lastUsed;
+  size_t bytes;
+  uint16_t *pixels[FRAME_CACHE_SEGMENTS];
+};
+
+/**
+ * Decoded frames keyed by path and modification time, least recently used ones are evicted to stay within the budget.
+ * Memory is allocated per segment, from PSRAM if there is any, so internal heap can hold the first segments of a frame
+ * when it has no room for all of them.
+ * find(), insert(), reserve(), finish() and evict() expect the caller to hold lock(). Whoever draws from an entry
+ * keeps holding it until the pixels were pushed, so eviction from another task waits for the draw. A reserved entry
+ * is filled without the lock: eviction leaves its memory to finish() instead of waiting.
+ */
+class FrameCache
+{
+private:
+  CachedFrame entries[FRAME_CACHE_ENTRIES];
+  size_t budget = 0;
+  size_t usedBytes = 0;
+  uint32_t caps = 0;
+  uint32_t tick = 0;
+  uint32_t hitCount = 0;
+  uint32_t missCount = 0;
+  uint32_t evictionCount = 0;
+  SemaphoreHandle_t mutex = nullptr;
+
+  size_t segmentBytes(const CachedFrame &frame, uint8_t segment) const
+  {
+    uint16_t y = segment * frame.rows;
+    uint16_t h = frame.height - y < frame.rows ? frame.height - y : frame.rows;
+    return (size_t)frame.width * h * sizeof(uint16_t);
+  }
+
+  void release(CachedFrame &frame)
+  {
+    for (uint8_t i = 0; i < frame.cached; i++)
+    {
+      heap_caps_free(frame.pixels[i]);
+      frame.pixels[i] = nullptr;
+    }
+    usedBytes -= frame.bytes;
+    frame.path = "";
+    frame.cached = 0;
+    frame.bytes = 0;
+    frame.complete = false;
+    frame.filling = false;
+    frame.stale = false;
+  }
+
+  // Frees the least recently used entry other than `keep`, false if there is none
+  bool evictOldest(const CachedFrame *keep)
+  {
+    CachedFrame *oldest = nullptr;
+    for (CachedFrame &frame : entries)
+    {
+      if (&frame != keep && frame.cached > 0 && !frame.filling && (!oldest || (int32_t)(frame.lastUsed - oldest->lastUsed) < 0))
+      {
+        oldest = &frame;
+      }
+    }
+    if (!oldest)
+    {
+      return false;
+    }
+    LOG_DEBUG("Frame cache: evicting %s", oldest->path.c_str());
+    release(*oldest);
+    evictionCount++;
+    return true;
+  }
+
+public:
+  void begin()
+  {
+    if (!mutex)
+    {
+      mutex = xSemaphoreCreateMutex();
+    }
+    bool psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    caps = psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    budget = psram ? FRAME_CACHE_PSRAM_BUDGET : FRAME_CACHE_HEAP_BUDGET;
+    LOG_INFO("Frame cache: %u bytes of %s", budget, psram ? "PSRAM" : "internal heap");
+  }
+
+  void lock()
+  {
+    if (mutex)
+    {
+      xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+  }
+  void unlock()
+  {
+    if (mutex)
+    {
+      xSemaphoreGive(mutex);
+    }
+  }
+
+  // Complete entry for the file, nullptr on a miss
+  CachedFrame *find(const String &path, time_t mtime)
+  {
+    for (CachedFrame &frame : entries)
+    {
+      if (frame.complete && frame.mtime == mtime && frame.path == path)
+      {
+        frame.lastUsed = ++tick;
+        hitCount++;
+        return &frame;
+      }
+    }
+    missCount++;
+    return nullptr;
+  }
+
+  // Same as find() without touching the counters or the LRU order
+  bool contains(const String &path, time_t mtime) const
+  {
+    for (const CachedFrame &frame : entries)
+    {
+      if (frame.complete && frame.mtime == mtime && frame.path == path)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Allocates as many leading segments as the budget allows, nullptr if not even one fits.
+  // The caller fills them while drawing and then calls finish().
+  CachedFrame *insert(const String &path, time_t mtime, uint16_t width, uint16_t height, uint16_t rows, bool bigEndian)
+  {
+    if (budget == 0 || width == 0 || rows == 0)
+    {
+      return nullptr;
+    }
+    evict(path);
+    CachedFrame *frame = nullptr;
+    for (CachedFrame &candidate : entries)
+    {
+      frame = candidate.cached == 0 ? &candidate : frame;
+    }
+    if (!frame)
+    {
+      evictOldest(nullptr);
+      for (CachedFrame &candidate : entries)
+      {
+        frame = candidate.cached == 0 ? &candidate : frame;
+      }
+      if (!frame)
+      {
+        return nullptr; // every entry is being filled
+      }
+    }
+    frame->path = path;
+    frame->mtime = mtime;
+    frame->width = width;
+    frame->height = height;
+    frame->rows = rows;
+    frame->segments = (height + rows - 1) / rows;
+    frame->bigEndian = bigEndian;
+    frame->complete = false;
+    frame->filling = false;
+    frame->stale = false;
+    frame->lastUsed = ++tick;
+    while (frame->cached < frame->segments && frame->cached < FRAME_CACHE_SEGMENTS)
+    {
+      size_t size = segmentBytes(*frame, frame->cached);
+      while (usedBytes + size > budget && evictOldest(frame))
+      {
+      }
+      if (usedBytes + size > budget ||
+          (!(caps & MALLOC_CAP_SPIRAM) && heap_caps_get_free_size(caps) < size + FRAME_CACHE_HEAP_RESERVE))
+      {
+        break;
+      }
+      uint16_t *pixels = (uint16_t *)heap_caps_malloc(size, caps);
+      if (!pixels)
+      {
+        break;
+      }
+      frame->pixels[frame->cached++] = pixels;
+      frame->bytes += size;
+      usedBytes += size;
+    }
+    if (frame->cached == 0)
+    {
+      frame->path = "";
+      return nullptr;
+    }
+    return frame;
+  }
+
+  // As insert(), for a caller that fills the segments after unlock() and takes the lock again for finish()
+  CachedFrame *reserve(const String &path, time_t mtime, uint16_t width, uint16_t height, uint16_t rows, bool bigEndian)
+  {
+    CachedFrame *frame = insert(path, mtime, width, height, rows, bigEndian);
+    if (frame)
+    {
+      frame->filling = true;
+    }
+    return frame;
+  }
+
+  // Keeps the entry if all its segments were filled and it was not evicted meanwhile, drops it otherwise
+  void finish(CachedFrame *frame, bool filled)
+  {
+    frame->filling = false;
+    if (filled && !frame->stale)
+    {
+      frame->complete = true;
+    }
+    else
+    {
+      release(*frame);
+    }
+  }
+
+  void evict(const String &path)
+  {
+    for (CachedFrame &frame : entries)
+    {
+      if (frame.cached > 0 && frame.path == path && !frame.stale)
+      {
+        if (frame.filling)
+        {
+          frame.stale = true;
+        }
+        else
+        {
+          release(frame);
+        }
+        evictionCount++;
+      }
+    }
+  }
+
+  size_t used() const { return usedBytes; }
+  size_t capacity() const { return budget; }
+  uint32_t hits() const { return hitCount; }
+  uint32_t misses() const { return missCount; }
+  uint32_t evictions() const { return evictionCount; }
+};
+
+FrameCache frame_cache;
+
+#endif
@@ -4,6 +4,9 @@
 #define FORMAT_LITTLEFS_IF_FAILED true
 
 #include "LittleFS.h"
+#include "lib_log.h"
+#include "lib_metrics.h"
+#include <esp_rom_crc.h>
 #define SPIFFS LittleFS
 
 void listDirCallback(fs::FS &fs, const char *dirname, void (*callback)(File &))
@@ -95,30 +98,89 @@ uint16_t swapEndian(uint16_t value)
   return (value >> 8) | (value << 8);
 }
 
-void readRGB565File(fs::FS &fs, const char *path, uint16_t *data, uint32_t length, uint32_t offset)
+// Swaps two pixels per 32 bit word, falls back to single pixels for unaligned edges
+void swapEndian(uint16_t *data, uint32_t length)
 {
-  File file = fs.open(path);
-  if (!file)
+  uint32_t i = 0;
+  if (((uintptr_t)data & 0x3) && length > 0)
   {
-    Serial.println(F("Failed to open file for reading"));
-    return;
+    data[0] = swapEndian(data[0]);
+    i = 1;
+  }
+  uint32_t *words = (uint32_t *)(data + i);
+  uint32_t wordCount = (length - i) / 2;
+  for (uint32_t w = 0; w < wordCount; w++)
+  {
+    uint32_t v = words[w];
+    words[w] = ((v & 0xFF00FF00) >> 8) | ((v & 0x00FF00FF) << 8);
   }
+  for (i += wordCount * 2; i < length; i++)
+  {
+    data[i] = swapEndian(data[i]);
+  }
+}
 
-  // Seek to the specified offset
-  file.seek(offset * sizeof(uint16_t) / sizeof(char));
+// Keeps an RGB565 file open so consecutive slices can be read without reopening and seeking
+class RGB565FileReader
+{
+private:
+  File file;
 
-  // Read the RGB565 data directly into the uint16_t array
-  size_t bytesRead = file.readBytes((char *)data, length * sizeof(uint16_t));
-  if (bytesRead != length * sizeof(uint16_t))
+public:
+  bool begin(fs::FS &fs, const char *path, uint32_t offset = 0)
   {
-    Serial.println("Failed to read the expected amount of data");
+    file = fs.open(path);
+    if (!file)
+    {
+      LOG_ERROR("Failed to open file for reading: %s", path);
+      return false;
+    }
+    if (offset > 0)
+    {
+      file.seek(offset * sizeof(uint16_t));
+    }
+    return true;
   }
-  file.close();
 
-  for (int i = 0; i < length; i++)
+  // Reads the next `length` pixels as stored in the file (big endian), returns the number of pixels read
+  uint32_t read(uint16_t *data, uint32_t length)
   {
-    data[i] = swapEndian(data[i]);
+    size_t bytesRead = file.readBytes((char *)data, length * sizeof(uint16_t));
+    metrics.fsReadBytes.add(bytesRead);
+    if (bytesRead != length * sizeof(uint16_t))
+    {
+      LOG_WARN("Failed to read the expected amount of data");
+    }
+    return bytesRead / sizeof(uint16_t);
   }
+
+  void end()
+  {
+    if (file)
+    {
+      file.close();
+    }
+  }
+
+  ~RGB565FileReader()
+  {
+    end();
+  }
+};
+
+void readRGB565File(fs::FS &fs, const char *path, uint16_t *data, uint32_t length, uint32_t offset)
+{
+  RGB565FileReader reader;
+  if (!reader.begin(fs, path, offset))
+  {
+    return;
+  }
+
+  // Read the RGB565 data directly into the uint16_t array
+  reader.read(data, length);
+  reader.end();
+
+  swapEndian(data, length);
 }
 
 int readFileToLong(fs::FS &fs, const char *path, long *data)
@@ -146,23 +208,24 @@ int readFileToLong(fs::FS &fs, const char *path, long *data)
 
 int readFileToConstChar(fs::FS &fs, const char *path, const char *data, size_t max_length)
 {
-  Serial.printf("Reading file: %s\n", path);
+  LOG_DEBUG("Reading file: %s", path);
 
   File file = fs.open(path);
   if (!file)
   {
-    Serial.println("Failed to open file for reading");
+    LOG_ERROR("Failed to open file for reading: %s", path);
     return -1;
   }
   size_t bytesRead = file.readBytes((char *)data, max_length - 1);
+  metrics.fsReadBytes.add(bytesRead);
   if (bytesRead == 0)
   {
-    Serial.println("Failed to read from file or file is empty");
+    LOG_WARN("Failed to read from file or file is empty: %s", path);
     file.close();
     return -2;
   }
   file.close();
-  Serial.printf("Read const char value: %s\n", *data);
+  LOG_DEBUG("Read const char value: %s", data);
   return 0;
 }
 
@@ -172,6 +235,7 @@ void readFileToString(fs::FS &fs, const char *path, String &data)
   if (file)
   {
     String offsetVal = file.readStringUntil('\n');
+    metrics.fsReadBytes.add(offsetVal.length());
     data = offsetVal;
     file.close();
   }
@@ -198,21 +262,23 @@ void readFileToConsole(fs::FS &fs, const char *path)
 
 void writeFile(fs::FS &fs, const char *path, const char *message)
 {
-  Serial.printf("Writing file: %s\n", path);
+  LOG_DEBUG("Writing file: %s", path);
 
   File file = fs.open(path, FILE_WRITE);
   if (!file)
   {
-    Serial.println("Failed to open file for writing");
+    LOG_ERROR("Failed to open file for writing: %s", path);
     return;
   }
-  if (file.print(message))
+  size_t written = file.print(message);
+  metrics.fsWriteBytes.add(written);
+  if (written)
   {
-    Serial.println("File written");
+    LOG_INFO("File written: %s", path);
   }
   else
   {
-    Serial.println("Write failed");
+    LOG_ERROR("Write failed: %s", path);
   }
   file.close();
 }
@@ -264,10 +330,167 @@ void deleteFile(fs::FS &fs, const char *path)
   }
 }
 
+#define UPLOAD_BUFFER_SIZE 4096 // one LittleFS block, 0 writes every chunk as it arrives
+#define UPLOAD_TEMP_SUFFIX ".part"
+
+/**
+ * Collects upload chunks into block sized writes to `path`.part and renames it over `path` once
+ * the upload completed and matched the expected length and CRC-32, if given.
+ * Until then the old file stays in place, a broken upload only leaves the .part file behind.
+ */
+class UploadWriter
+{
+private:
+  fs::FS *fs = nullptr;
+  File file;
+  String path;
+  String tempPath;
+  uint8_t *buffer = nullptr;
+  size_t buffered = 0;
+  uint32_t written = 0;
+  uint32_t writes = 0;
+  uint32_t crc = 0;
+  uint32_t startedAt = 0;
+  bool failed = false;
+
+  void flushBuffer()
+  {
+    if (buffered > 0 && !failed)
+    {
+      failed = file.write(buffer, buffered) != buffered;
+      metrics.fsWriteBytes.add(buffered);
+      writes++;
+    }
+    buffered = 0;
+  }
+
+  void release()
+  {
+    if (file)
+    {
+      file.close();
+    }
+    free(buffer);
+    buffer = nullptr;
+    buffered = 0;
+    fs = nullptr;
+  }
+
+public:
+  ~UploadWriter()
+  {
+    abort();
+  }
+
+  bool isActive() const { return fs != nullptr; }
+  const String &target() const { return path; }
+
+  bool begin(fs::FS &filesystem, const String &target)
+  {
+    abort();
+    path = target;
+    tempPath = target + UPLOAD_TEMP_SUFFIX;
+    file = filesystem.open(tempPath, "w");
+    if (!file)
+    {
+      LOG_ERROR("Failed to open file for writing: %s", tempPath.c_str());
+      return false;
+    }
+    fs = &filesystem;
+    buffer = UPLOAD_BUFFER_SIZE > 0 ? (uint8_t *)malloc(UPLOAD_BUFFER_SIZE) : nullptr;
+    buffered = 0;
+    written = 0;
+    writes = 0;
+    crc = 0;
+    failed = false;
+    startedAt = micros();
+    return true;
+  }
+
+  bool write(const uint8_t *data, size_t length)
+  {
+    if (!isActive() || failed)
+    {
+      return false;
+    }
+    crc = esp_rom_crc32_le(crc, data, length);
+    written += length;
+    if (!buffer)
+    {
+      failed = file.write(data, length) != length;
+      metrics.fsWriteBytes.add(length);
+      writes++;
+      return !failed;
+    }
+    while (length > 0)
+    {
+      size_t n = min(length, UPLOAD_BUFFER_SIZE - buffered);
+      memcpy(buffer + buffered, data, n);
+      buffered += n;
+      data += n;
+      length -= n;
+      if (buffered == UPLOAD_BUFFER_SIZE)
+      {
+        flushBuffer();
+      }
+    }
+    return !failed;
+  }
+
+  // Zero skips the check. Returns false and removes the temporary file if anything went wrong.
+  bool finish(uint32_t expectedLength = 0, uint32_t expectedCrc = 0)
+  {
+    if (!isActive())
+    {
+      return false;
+    }
+    flushBuffer();
+    file.close();
+    fs::FS &filesystem = *fs;
+    uint32_t elapsed = micros() - startedAt;
+    bool valid = !failed && (expectedLength == 0 || written == expectedLength) && (expectedCrc == 0 || crc == expectedCrc);
+    release();
+
+    if (!valid)
+    {
+      LOG_WARN("Upload %s rejected: %u bytes, crc=%08x, write error=%d", path.c_str(), written, crc, failed);
+      filesystem.remove(tempPath);
+      return false;
+    }
+    if (!filesystem.rename(tempPath, path))
+    {
+      filesystem.remove(path);
+      if (!filesystem.rename(tempPath, path))
+      {
+        LOG_ERROR("Failed to rename %s", tempPath.c_str());
+        filesystem.remove(tempPath);
+        return false;
+      }
+    }
+    LOG_INFO("Upload %s: %u bytes in %u writes, %lums, %lu KB/s", path.c_str(), written, writes, elapsed / 1000,
+             elapsed ? (unsigned long)((uint64_t)written * 1000000 / elapsed / 1024) : 0);
+    return true;
+  }
+
+  void abort()
+  {
+    if (isActive())
+    {
+      fs::FS &filesystem = *fs;
+      release();
+      filesystem.remove(tempPath);
+      LOG_WARN("Upload %s aborted after %u bytes", path.c_str(), written);
+    }
+  }
+
+  uint32_t bytes() const { return written; }
+  uint32_t checksum() const { return crc; }
+};
+
 size_t getFreeSpace(fs::LittleFSFS &fs)
 {
   size_t freeSpace = fs.totalBytes() - fs.usedBytes();
-  Serial.printf("Free space: %ld bytes\n", freeSpace);
+  LOG_DEBUG("Free space: %u bytes", freeSpace);
   return freeSpace;
 }
 
@@ -281,9 +504,6 @@ void fs_setup()
     Serial.println(F("LittleFS Mount Failed"));
     return;
   }
-
-  Serial.println(F("----list 1----"));
-  listDir(SPIFFS, "/", 1);
 #endif
 }
 
@@ -0,0 +1,296 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "lib_fs.h"
+
+/**
+ * Image container: a 16 byte header followed by the pixel data.
+ * Files without the magic are treated as legacy .raw files (headerless, big endian RGB565).
+ * Compressed encodings use PackBits control bytes: 0x80 | (n - 1) repeats the next value n times,
+ * (n - 1) copies the next n values. Pixels keep the byte order given by the flags.
+ * Create containers with tools/image_convert.py
+ */
+#define IMAGE_MAGIC "R565"
+#define IMAGE_VERSION 1
+#define IMAGE_FLAG_LITTLE_ENDIAN 0x01 // pixels are stored LSB first, panel expects MSB first
+#define IMAGE_FLAG_BGR 0x02           // red and blue fields are swapped
+#define IMAGE_ENCODING_RAW 0
+#define IMAGE_ENCODING_RLE 1         // PackBits over pixels
+#define IMAGE_ENCODING_PALETTE_RLE 2 // uint16 color count and palette, then PackBits over 8 bit palette indices
+#define IMAGE_PALETTE_SIZE 256
+#define IMAGE_INPUT_BUFFER 2048
+
+struct __attribute__((packed)) ImageHeader
+{
+  char magic[4];
+  uint8_t version;
+  uint8_t flags;
+  uint16_t header_size;
+  uint16_t width;
+  uint16_t height;
+  uint8_t encoding;
+  uint8_t reserved[3];
+};
+
+// Converts pixels of a BGR image into native endian RGB565, only needed for files not produced by the converter
+void rgb565_from_bgr(uint16_t *data, uint32_t length, bool bigEndian)
+{
+  if (bigEndian)
+  {
+    swapEndian(data, length);
+  }
+  for (uint32_t i = 0; i < length; i++)
+  {
+    uint16_t v = data[i];
+    data[i] = (v << 11) | (v & 0x07E0) | (v >> 11);
+  }
+}
+
+class ImageReader
+{
+private:
+  File file;
+  ImageHeader header;
+  bool legacy;
+  uint32_t bytesRead;
+
+  // Decoder state, runs may continue across calls to read()
+  uint8_t input[IMAGE_INPUT_BUFFER];
+  uint16_t inputPos;
+  uint16_t inputLength;
+  uint8_t runLeft;
+  bool runLiteral;
+  uint16_t runPixel;
+  uint16_t *palette;
+  uint16_t paletteSize;
+
+  bool nextByte(uint8_t &value)
+  {
+    if (inputPos == inputLength)
+    {
+      inputLength = file.read(input, sizeof(input));
+      inputPos = 0;
+      bytesRead += inputLength;
+      if (inputLength == 0)
+      {
+        return false;
+      }
+    }
+    value = input[inputPos++];
+    return true;
+  }
+
+  // Keeps the file byte order, the blit path decides whether it needs swapping
+  bool nextPixel(uint16_t &pixel)
+  {
+    uint8_t b0, b1;
+    if (palette)
+    {
+      if (!nextByte(b0) || b0 >= paletteSize)
+      {
+        return false;
+      }
+      pixel = palette[b0];
+      return true;
+    }
+    if (!nextByte(b0) || !nextByte(b1))
+    {
+      return false;
+    }
+    pixel = b0 | (b1 << 8);
+    return true;
+  }
+
+  bool readPalette()
+  {
+    uint8_t lo, hi;
+    if (!nextByte(lo) || !nextByte(hi))
+    {
+      return false;
+    }
+    paletteSize = lo | (hi << 8);
+    if (paletteSize == 0 || paletteSize > IMAGE_PALETTE_SIZE)
+    {
+      return false;
+    }
+    palette = (uint16_t *)malloc(paletteSize * sizeof(uint16_t));
+    if (!palette)
+    {
+      return false;
+    }
+    uint16_t *entries = palette;
+    palette = nullptr; // read the entries as plain pixels
+    for (uint16_t i = 0; i < paletteSize; i++)
+    {
+      if (!nextPixel(entries[i]))
+      {
+        free(entries);
+        return false;
+      }
+    }
+    palette = entries;
+    return true;
+  }
+
+  uint32_t decode(uint16_t *data, uint32_t length)
+  {
+    uint32_t n = 0;
+    while (n < length)
+    {
+      if (runLeft == 0)
+      {
+        uint8_t control;
+        if (!nextByte(control))
+        {
+          break;
+        }
+        runLiteral = !(control & 0x80);
+        runLeft = (control & 0x7F) + 1;
+        if (!runLiteral && !nextPixel(runPixel))
+        {
+          break;
+        }
+      }
+      if (runLiteral)
+      {
+        while (runLeft > 0 && n < length)
+        {
+          if (!nextPixel(data[n]))
+          {
+            return n;
+          }
+          n++;
+          runLeft--;
+        }
+      }
+      else
+      {
+        uint32_t count = length - n < runLeft ? length - n : runLeft;
+        for (uint32_t i = 0; i < count; i++)
+        {
+          data[n + i] = runPixel;
+        }
+        n += count;
+        runLeft -= count;
+      }
+    }
+    return n;
+  }
+
+public:
+  ImageReader() : legacy(false), bytesRead(0), inputPos(0), inputLength(0), runLeft(0), runLiteral(false), runPixel(0), palette(nullptr), paletteSize(0) {}
+
+  bool begin(fs::FS &fs, const char *path, uint16_t legacyWidth, uint16_t legacyHeight)
+  {
+    file = fs.open(path);
+    if (!file)
+    {
+      LOG_ERROR("Failed to open image for reading: %s", path);
+      return false;
+    }
+
+    legacy = file.readBytes((char *)&header, sizeof(header)) != sizeof(header) ||
+             memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0;
+    if (legacy)
+    {
+      memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+      header.version = 0;
+      header.flags = 0;
+      header.header_size = 0;
+      header.width = legacyWidth;
+      header.height = legacyHeight;
+      header.encoding = IMAGE_ENCODING_RAW;
+      file.seek(0);
+      return true;
+    }
+    bytesRead = sizeof(header);
+
+    if (header.version > IMAGE_VERSION || header.header_size < sizeof(header) || header.encoding > IMAGE_ENCODING_PALETTE_RLE)
+    {
+      LOG_WARN("Unsupported image %s: version=%u, encoding=%u", path, header.version, header.encoding);
+      end();
+      return false;
+    }
+    file.seek(header.header_size);
+
+    if (header.encoding == IMAGE_ENCODING_PALETTE_RLE && !readPalette())
+    {
+      LOG_WARN("Invalid palette in image %s", path);
+      end();
+      return false;
+    }
+    return true;
+  }
+
+  uint16_t width() const { return header.width; }
+  uint16_t height() const { return header.height; }
+  uint8_t flags() const { return header.flags; }
+  uint8_t encoding() const { return header.encoding; }
+  bool isLegacy() const { return legacy; }
+  bool bigEndian() const { return !(header.flags & IMAGE_FLAG_LITTLE_ENDIAN); }
+  uint32_t flashBytes() const { return bytesRead; }
+
+  // Reads the next `length` pixels in file byte order, returns the number of pixels read
+  uint32_t read(uint16_t *data, uint32_t length)
+  {
+    uint32_t pixelsRead;
+    if (header.encoding == IMAGE_ENCODING_RAW)
+    {
+      size_t n = file.readBytes((char *)data, length * sizeof(uint16_t));
+      bytesRead += n;
+      pixelsRead = n / sizeof(uint16_t);
+    }
+    else
+    {
+      pixelsRead = decode(data, length);
+    }
+    if (pixelsRead != length)
+    {
+      LOG_WARN("Failed to read the expected amount of data");
+    }
+    return pixelsRead;
+  }
+
+  // Moves past the next `length` pixels, compressed images are decoded on the way
+  uint32_t skip(uint32_t length)
+  {
+    if (header.encoding == IMAGE_ENCODING_RAW)
+    {
+      return file.seek(file.position() + length * sizeof(uint16_t)) ? length : 0;
+    }
+    uint16_t scratch[64];
+    uint32_t skipped = 0;
+    while (skipped < length)
+    {
+      uint32_t want = length - skipped < 64 ? length - skipped : 64;
+      uint32_t n = decode(scratch, want);
+      skipped += n;
+      if (n < want)
+      {
+        break;
+      }
+    }
+    return skipped;
+  }
+
+  void end()
+  {
+    if (file)
+    {
+      metrics.fsReadBytes.add(bytesRead);
+      file.close();
+    }
+    if (palette)
+    {
+      free(palette);
+      palette = nullptr;
+    }
+  }
+
+  ~ImageReader()
+  {
+    end();
+  }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdarg.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are compiled out
+#ifndef LOGGER_LEVEL
+#define LOGGER_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_SLOTS 64      // power of two, lines waiting for the drain task
+#define LOG_LINE_SIZE 120 // longer messages are truncated
+#define LOG_TAIL_LINES 32 // recent lines kept for /log
+#define LOG_DRAIN_MS 10
+
+struct LogRecord
+{
+  std::atomic<uint32_t> sequence;
+  uint32_t ms;
+  uint8_t level;
+  char text[LOG_LINE_SIZE];
+};
+
+/**
+ * Bounded multi producer, single consumer queue of formatted lines (sequence numbered slots).
+ * Producers claim a slot with one compare-and-swap and never wait, a full queue drops the line.
+ */
+class LogRing
+{
+private:
+  LogRecord slots[LOG_SLOTS];
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) uint32_t tail; // only touched by the drain task
+
+public:
+  std::atomic<uint32_t> written;
+  std::atomic<uint32_t> dropped;
+  std::atomic<uint32_t> truncated;
+
+  LogRing() : head(0), tail(0), written(0), dropped(0), truncated(0)
+  {
+    for (uint32_t i = 0; i < LOG_SLOTS; i++)
+    {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(uint8_t level, const char *format, va_list args)
+  {
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    LogRecord *slot;
+    for (;;)
+    {
+      slot = &slots[pos % LOG_SLOTS];
+      int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+      if (diff == 0)
+      {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else
+      {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->ms = millis();
+    slot->level = level;
+    if (vsnprintf(slot->text, LOG_LINE_SIZE, format, args) >= LOG_LINE_SIZE)
+    {
+      truncated.fetch_add(1, std::memory_order_relaxed);
+    }
+    written.fetch_add(1, std::memory_order_relaxed);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Drain task only, hands the oldest line to `callback`
+  template <typename Callback>
+  bool pop(Callback callback)
+  {
+    LogRecord &slot = slots[tail % LOG_SLOTS];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+    {
+      return false;
+    }
+    callback(slot);
+    slot.sequence.store(tail + LOG_SLOTS, std::memory_order_release);
+    tail++;
+    return true;
+  }
+};
+
+LogRing log_ring;
+char log_tail[LOG_TAIL_LINES][LOG_LINE_SIZE + 16];
+uint32_t log_tail_next = 0;
+portMUX_TYPE log_tail_lock = portMUX_INITIALIZER_UNLOCKED;
+bool log_task_running = false;
+std::atomic<bool> log_draining(false);
+
+const char log_level_names[] = "-EWID";
+
+void log_printf(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#if LOGGER_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_printf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_printf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_printf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_printf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+// Writes the oldest queued line to Serial and keeps it for log_tail_append(), false if there was none
+bool log_drain()
+{
+  return log_ring.pop([](const LogRecord &record)
+               {
+    char line[LOG_LINE_SIZE + 16];
+    snprintf(line, sizeof(line), "[%lu.%03lu] %c %s", (unsigned long)(record.ms / 1000), (unsigned long)(record.ms % 1000),
+             log_level_names[record.level], record.text);
+    Serial.println(line);
+
+    portENTER_CRITICAL(&log_tail_lock);
+    memcpy(log_tail[log_tail_next % LOG_TAIL_LINES], line, sizeof(line));
+    log_tail_next++;
+    portEXIT_CRITICAL(&log_tail_lock); });
+}
+
+void log_printf(uint8_t level, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  log_ring.push(level, format, args);
+  va_end(args);
+
+  // Before log_setup() or without the task the caller drains, one at a time
+  if (!log_task_running && !log_draining.exchange(true, std::memory_order_acquire))
+  {
+    while (log_drain())
+    {
+    }
+    log_draining.store(false, std::memory_order_release);
+  }
+}
+
+void log_task(void *)
+{
+  for (;;)
+  {
+    while (log_drain())
+    {
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+  }
+}
+
+// Appends the most recent lines, oldest first
+void log_tail_append(String &out)
+{
+  char line[LOG_LINE_SIZE + 16];
+  uint32_t end = log_tail_next;
+  uint32_t start = end > LOG_TAIL_LINES ? end - LOG_TAIL_LINES : 0;
+  for (uint32_t i = start; i < end; i++)
+  {
+    portENTER_CRITICAL(&log_tail_lock);
+    bool overwritten = log_tail_next - i > LOG_TAIL_LINES;
+    memcpy(line, log_tail[i % LOG_TAIL_LINES], sizeof(line));
+    portEXIT_CRITICAL(&log_tail_lock);
+    if (!overwritten)
+    {
+      out += line;
+      out += "\n";
+    }
+  }
+}
+
+void log_setup()
+{
+  log_task_running = xTaskCreate(log_task, "log", 3072, nullptr, tskIDLE_PRIORITY, nullptr) == pdPASS;
+  if (!log_task_running)
+  {
+    Serial.println(F("Log task not available, logging synchronously"));
+  }
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdarg.h>
+
+#define METRICS_BUFFER_SIZE 16384 // one scrape, rendered in place
+#define METRICS_ROUTES 16
+#define METRICS_BUCKETS 10
+
+// Upper bounds of the latency buckets in microseconds, everything above ends up in +Inf
+static const uint32_t metrics_buckets_us[METRICS_BUCKETS] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+struct MetricCounter
+{
+  std::atomic<uint32_t> value{0};
+
+  void add(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Cumulative only on export, observe() bumps a single bucket
+class MetricHistogram
+{
+public:
+  struct Snapshot
+  {
+    uint32_t buckets[METRICS_BUCKETS + 1];
+    uint32_t count;
+    uint64_t sumUs;
+  };
+
+private:
+  Snapshot data = {};
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+  void observe(uint32_t us)
+  {
+    uint8_t bucket = 0;
+    while (bucket < METRICS_BUCKETS && us > metrics_buckets_us[bucket])
+    {
+      bucket++;
+    }
+    portENTER_CRITICAL(&lock);
+    data.buckets[bucket]++;
+    data.count++;
+    data.sumUs += us;
+    portEXIT_CRITICAL(&lock);
+  }
+
+  Snapshot snapshot() const
+  {
+    portENTER_CRITICAL(&lock);
+    Snapshot copy = data;
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+};
+
+struct RouteMetric
+{
+  const char *path;
+  MetricHistogram latency;
+};
+
+/**
+ * Counters and histograms updated from the hot paths, gauges are read when scraped.
+ * Routes are registered while the server is set up and never removed.
+ */
+struct Metrics
+{
+  MetricCounter fsReadBytes;
+  MetricCounter fsWriteBytes;
+  MetricCounter ntpSuccess;
+  MetricCounter ntpFailure;
+  MetricHistogram ntpLatency;
+  MetricHistogram frame;
+  MetricHistogram loop; // work done per loop() iteration, waiting excluded
+  RouteMetric routes[METRICS_ROUTES];
+  uint8_t routeCount = 0;
+
+  // Returns nullptr once all slots are taken
+  MetricHistogram *route(const char *path)
+  {
+    if (routeCount >= METRICS_ROUTES)
+    {
+      return nullptr;
+    }
+    routes[routeCount].path = path;
+    return &routes[routeCount++].latency;
+  }
+};
+
+Metrics metrics;
+
+// Prometheus text format into a fixed buffer, output past the end is cut off and flagged
+class MetricsWriter
+{
+private:
+  char *buffer;
+  size_t capacity;
+  size_t used = 0;
+  bool overflow = false;
+
+public:
+  MetricsWriter(char *buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+  size_t length() const { return used; }
+  bool truncated() const { return overflow; }
+
+  void printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    if (overflow)
+    {
+      return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + used, capacity - used, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= capacity - used)
+    {
+      overflow = true;
+      return;
+    }
+    used += n;
+  }
+
+  void describe(const char *name, const char *type, const char *help)
+  {
+    printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  }
+
+  void value(const char *name, uint32_t value, const char *labels = nullptr)
+  {
+    if (labels)
+    {
+      printf("%s{%s} %u\n", name, labels, value);
+    }
+    else
+    {
+      printf("%s %u\n", name, value);
+    }
+  }
+
+  // Microseconds as seconds without trailing zeros, 2500 becomes 0.0025
+  static void formatSeconds(char *out, size_t size, uint64_t us)
+  {
+    int n = snprintf(out, size, "%llu.%06llu", us / 1000000, us % 1000000);
+    while (n > 1 && out[n - 1] == '0')
+    {
+      out[--n] = 0;
+    }
+    if (out[n - 1] == '.')
+    {
+      out[--n] = 0;
+    }
+  }
+
+  // `labels` goes in front of le, e.g. route="/files"
+  void histogram(const char *name, const MetricHistogram &histogram, const char *labels = nullptr)
+  {
+    MetricHistogram::Snapshot snapshot = histogram.snapshot();
+    const char *separator = labels ? "," : "";
+    labels = labels ? labels : "";
+    char seconds[24];
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < METRICS_BUCKETS; i++)
+    {
+      cumulative += snapshot.buckets[i];
+      formatSeconds(seconds, sizeof(seconds), metrics_buckets_us[i]);
+      printf("%s_bucket{%s%sle=\"%s\"} %u\n", name, labels, separator, seconds, cumulative);
+    }
+    printf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, separator, snapshot.count);
+    const char *open = *labels ? "{" : "";
+    const char *close = *labels ? "}" : "";
+    formatSeconds(seconds, sizeof(seconds), snapshot.sumUs);
+    printf("%s_sum%s%s%s %s\n", name, open, labels, close, seconds);
+    printf("%s_count%s%s%s %u\n", name, open, labels, close, snapshot.count);
+  }
+};
+
+#endif
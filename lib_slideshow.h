@@ -0,0 +1,301 @@
+#ifndef SLIDESHOW_H
+#define SLIDESHOW_H
+
+#include <Arduino.h>
+#include <vector>
+#include <esp_timer.h>
+#include "lib_display.h"
+#include "lib_log.h"
+#include "lib_metrics.h"
+
+#define SLIDESHOW_MAX_FRAMES 64
+#define SLIDESHOW_DEFAULT_MS 1000
+#define SLIDESHOW_MAX_MS 3600000 // per frame, longer durations are clamped so a frame's slot fits 32 bit microseconds
+#define SLIDESHOW_PATH_SIZE 64
+#define SLIDESHOW_PREFETCH_STACK 8192    // display_prefetch() has an ImageReader with its input buffer on the stack
+#define SLIDESHOW_PREFETCH_STACK_LOW 1024 // warn once when less than this was ever left free
+
+struct SlideshowFrame
+{
+  String path;
+  uint32_t durationMs;
+};
+
+struct PrefetchJob
+{
+  char path[SLIDESHOW_PATH_SIZE];
+};
+
+/**
+ * Plays a playlist file from LittleFS, one frame per line: `<path> [duration ms]`.
+ * `fps <n>` sets the duration of the lines that follow without one, `#` starts a comment.
+ * Frames are due on a fixed schedule from the start, frames whose slot already passed are dropped so the
+ * show never drifts. The next frame is decoded into the frame cache by a background task while the current one is shown.
+ * Driven by loop() through tick(), which never blocks on the schedule. The schedule runs on the 64 bit esp_timer clock,
+ * micros() wraps after about 71 minutes and a playlist cycle can be longer than that.
+ */
+class Slideshow
+{
+private:
+  std::vector<SlideshowFrame> frames;
+  String playlist;
+  size_t index = 0;
+  uint64_t due = 0;       // esp_timer_get_time() the current frame is due
+  uint64_t cycleUs = 0;   // one pass over the playlist
+  uint32_t startedAt = 0; // millis()
+  uint32_t shownCount = 0;
+  uint32_t droppedCount = 0;
+  uint64_t latenessTotalUs = 0;
+  uint32_t latenessMaxUs = 0;
+  MetricHistogram lateness; // how late each shown frame started
+  QueueHandle_t prefetchJobs = nullptr;
+  static volatile uint32_t prefetchStackFree; // bytes, lowest so far; 0 until the first prefetch
+  SemaphoreHandle_t mutex = nullptr; // the schedule and counters change in loop() while the web server reports them
+
+  static void prefetchTask(void *arg)
+  {
+    QueueHandle_t jobs = (QueueHandle_t)arg;
+    PrefetchJob job;
+    bool warned = false;
+    for (;;)
+    {
+      if (xQueueReceive(jobs, &job, portMAX_DELAY) == pdTRUE)
+      {
+#if LOGGER_LEVEL >= LOG_LEVEL_DEBUG
+        uint32_t start = micros();
+        bool cached = display_prefetch(job.path);
+        LOG_DEBUG("Prefetched %s: cached=%d in %luus", job.path, cached, micros() - start);
+#else
+        display_prefetch(job.path);
+#endif
+        prefetchStackFree = uxTaskGetStackHighWaterMark(nullptr);
+        if (prefetchStackFree < SLIDESHOW_PREFETCH_STACK_LOW && !warned)
+        {
+          LOG_WARN("Prefetch task has %u of %u stack bytes left", prefetchStackFree, SLIDESHOW_PREFETCH_STACK);
+          warned = true;
+        }
+      }
+    }
+  }
+
+  void lock()
+  {
+    if (mutex)
+    {
+      xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+  }
+  void unlock()
+  {
+    if (mutex)
+    {
+      xSemaphoreGive(mutex);
+    }
+  }
+
+  void prefetch(const String &path)
+  {
+    if (!prefetchJobs || path.length() >= SLIDESHOW_PATH_SIZE)
+    {
+      return;
+    }
+    PrefetchJob job;
+    strcpy(job.path, path.c_str());
+    xQueueOverwrite(prefetchJobs, &job); // only the next frame matters
+  }
+
+  bool parse(fs::FS &fs, const String &path)
+  {
+    File file = fs.open(path);
+    if (!file)
+    {
+      LOG_ERROR("Failed to open playlist %s", path.c_str());
+      return false;
+    }
+    uint32_t defaultMs = SLIDESHOW_DEFAULT_MS;
+    while (file.available() && frames.size() < SLIDESHOW_MAX_FRAMES)
+    {
+      String line = file.readStringUntil('\n');
+      metrics.fsReadBytes.add(line.length() + 1);
+      line.trim();
+      if (line.isEmpty() || line.startsWith("#"))
+      {
+        continue;
+      }
+      int space = line.indexOf(' ');
+      String first = space < 0 ? line : line.substring(0, space);
+      long value = space < 0 ? 0 : line.substring(space + 1).toInt();
+      if (first == "fps")
+      {
+        defaultMs = value > 0 ? max(1000 / value, 1L) : defaultMs;
+        continue;
+      }
+      if (value > SLIDESHOW_MAX_MS)
+      {
+        LOG_WARN("Playlist %s: %s shown for %ldms, clamped to %ums", path.c_str(), first.c_str(), value, SLIDESHOW_MAX_MS);
+        value = SLIDESHOW_MAX_MS;
+      }
+      frames.push_back({first, value > 0 ? (uint32_t)value : defaultMs});
+    }
+    file.close();
+    return !frames.empty();
+  }
+
+public:
+  // Creates the prefetch task, returns false if it is not available and frames are read when shown
+  bool begin()
+  {
+    mutex = xSemaphoreCreateMutex();
+    prefetchJobs = xQueueCreate(1, sizeof(PrefetchJob));
+    if (!prefetchJobs || xTaskCreate(prefetchTask, "prefetch", SLIDESHOW_PREFETCH_STACK, prefetchJobs, tskIDLE_PRIORITY + 1, nullptr) != pdPASS)
+    {
+      LOG_WARN("Prefetch task not available");
+      prefetchJobs = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  // Starts `path` from its first frame, an empty path stops the show
+  bool start(fs::FS &fs, const String &path)
+  {
+    stop();
+    if (path.isEmpty())
+    {
+      return false;
+    }
+    lock();
+    bool parsed = parse(fs, path);
+    if (!parsed)
+    {
+      frames.clear();
+      unlock();
+      LOG_WARN("Playlist %s has no frames", path.c_str());
+      return false;
+    }
+    playlist = path;
+    for (const SlideshowFrame &frame : frames)
+    {
+      cycleUs += (uint64_t)frame.durationMs * 1000;
+    }
+    startedAt = millis();
+    due = esp_timer_get_time();
+    unlock();
+    prefetch(frames[0].path);
+    LOG_INFO("Playlist %s: %u frames, %llums per cycle", path.c_str(), frames.size(), cycleUs / 1000);
+    return true;
+  }
+
+  void stop()
+  {
+    lock();
+    frames.clear();
+    playlist = "";
+    index = 0;
+    cycleUs = 0;
+    shownCount = 0;
+    droppedCount = 0;
+    latenessTotalUs = 0;
+    latenessMaxUs = 0;
+    unlock();
+  }
+
+  bool isActive()
+  {
+    lock();
+    bool active = !frames.empty();
+    unlock();
+    return active;
+  }
+
+  // Shows the frame that is due, if any, and returns the milliseconds until the next one.
+  // The schedule is only touched under the lock, the picture is drawn without it.
+  uint32_t tick()
+  {
+    lock();
+    if (frames.empty())
+    {
+      unlock();
+      return UINT32_MAX;
+    }
+    uint64_t now = esp_timer_get_time();
+    if (due > now)
+    {
+      uint64_t early = due - now;
+      unlock();
+      return (early + 999) / 1000;
+    }
+    if (now - due >= cycleUs)
+    {
+      // Held back for more than a cycle, e.g. by a VM program, start over from here instead of catching up
+      due = now;
+    }
+    while (now - due >= (uint64_t)frames[index].durationMs * 1000)
+    {
+      due += (uint64_t)frames[index].durationMs * 1000;
+      index = (index + 1) % frames.size();
+      droppedCount++;
+    }
+
+    // Less than the frame's duration after the loop above, which SLIDESHOW_MAX_MS keeps within 32 bits
+    uint32_t lateUs = now - due;
+    lateness.observe(lateUs);
+    latenessTotalUs += lateUs;
+    latenessMaxUs = max(latenessMaxUs, lateUs);
+    shownCount++;
+    String path = frames[index].path;
+    due += (uint64_t)frames[index].durationMs * 1000;
+    index = (index + 1) % frames.size();
+    String next = frames[index].path;
+    uint64_t nextDue = due;
+    unlock();
+
+    display_picture(path);
+    prefetch(next);
+    now = esp_timer_get_time();
+    return nextDue > now ? (uint32_t)((nextDue - now + 999) / 1000) : 0;
+  }
+
+  uint32_t shown()
+  {
+    lock();
+    uint32_t count = shownCount;
+    unlock();
+    return count;
+  }
+  uint32_t dropped()
+  {
+    lock();
+    uint32_t count = droppedCount;
+    unlock();
+    return count;
+  }
+  const MetricHistogram &latenessHistogram() const { return lateness; }
+  uint32_t prefetchStackLeft() const { return prefetchStackFree; }
+
+  void appendJson(String &out)
+  {
+    lock();
+    uint32_t elapsed = millis() - startedAt;
+    // Frames per second times 100
+    uint32_t target = cycleUs ? frames.size() * 100000000ULL / cycleUs : 0;
+    uint32_t achieved = elapsed ? (uint64_t)shownCount * 100000 / elapsed : 0;
+    out += "{\"playlist\":\"" + playlist + "\"";
+    out += ",\"frames\":" + String(frames.size());
+    out += ",\"shown\":" + String(shownCount);
+    out += ",\"dropped\":" + String(droppedCount);
+    out += ",\"target_fps\":" + String(target / 100.0f, 2);
+    out += ",\"achieved_fps\":" + String(achieved / 100.0f, 2);
+    out += ",\"jitter_avg_us\":" + String(shownCount ? (uint32_t)(latenessTotalUs / shownCount) : 0);
+    out += ",\"jitter_max_us\":" + String(latenessMaxUs);
+    out += ",\"prefetch_stack_free\":" + String(prefetchStackFree);
+    out += "}";
+    unlock();
+  }
+};
+
+volatile uint32_t Slideshow::prefetchStackFree = 0;
+
+Slideshow slideshow;
+
+#endif
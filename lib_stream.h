@@ -0,0 +1,162 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "lib_display.h"
+#include "lib_log.h"
+
+#define STREAM_HEADER_BYTES 8 // x, y, w, h as little endian uint16
+
+/**
+ * Pixels streamed straight to the panel, one instance per request.
+ * Either a single rectangle given up front, or a sequence of records each starting with a
+ * STREAM_HEADER_BYTES header followed by w * h big endian RGB565 pixels.
+ * Pixels are collected into segments of up to TFT_DRAW_SECTION pixels and each one is pushed through
+ * its own address window. Pushing blocks the caller, which holds back the sender through the TCP window.
+ * Plain data only, it lives in memory released with free().
+ */
+struct DisplayStream
+{
+  bool headers; // every rectangle comes with its own header
+  bool needHeader;
+  bool failed;
+  uint8_t header[STREAM_HEADER_BYTES];
+  uint8_t headerFill;
+  int16_t x, y, w, h;
+  int16_t row;      // first row of the segment being filled
+  uint32_t filled;  // bytes of the segment being filled
+  uint32_t frames;  // completed rectangles
+  uint32_t bytes;   // pixel bytes pushed
+  uint32_t ignored; // bytes after the last rectangle
+  uint32_t pushUs;
+  uint32_t startedAt;
+  uint16_t pixels[TFT_DRAW_SECTION];
+};
+
+// Frames completed over all streams, the rate is taken over windows of at least a second
+struct StreamMeter
+{
+  uint32_t frames;
+  uint32_t windowStart;
+  uint32_t windowFrames;
+  uint32_t fps100; // frames per second times 100 in the last complete window
+};
+StreamMeter display_stream_meter;
+
+void display_stream_frame()
+{
+  StreamMeter &meter = display_stream_meter;
+  uint32_t now = micros();
+  meter.frames++;
+  meter.windowFrames++;
+  if (meter.windowStart == 0 || now - meter.windowStart > 5000000)
+  {
+    // First frame after a pause starts a new window
+    meter.windowStart = now;
+    meter.windowFrames = 0;
+  }
+  else if (now - meter.windowStart >= 1000000)
+  {
+    meter.fps100 = (uint64_t)meter.windowFrames * 100000000 / (now - meter.windowStart);
+    meter.windowStart = now;
+    meter.windowFrames = 0;
+  }
+}
+
+// Returns nullptr if there is no memory for the segment buffer
+DisplayStream *display_stream_begin(bool headers, int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  DisplayStream *stream = (DisplayStream *)malloc(sizeof(DisplayStream));
+  if (!stream)
+  {
+    return nullptr;
+  }
+  memset(stream, 0, offsetof(DisplayStream, pixels));
+  stream->headers = headers;
+  stream->needHeader = headers;
+  stream->x = x;
+  stream->y = y;
+  stream->w = w;
+  stream->h = h;
+  stream->failed = !headers && (w <= 0 || h <= 0 || x < 0 || y < 0 || x + w > TFT_WIDTH || y + h > TFT_HEIGHT);
+  stream->startedAt = micros();
+  return stream;
+}
+
+void display_stream_push(DisplayStream *stream, int16_t rows)
+{
+  uint32_t start = micros();
+  {
+    DisplayLock lock;
+    display_push_pixels(stream->x, stream->y + stream->row, stream->pixels, stream->w, rows, true);
+    display.mirror(stream->x, stream->y + stream->row, stream->pixels, stream->w, rows, true, false);
+  }
+  stream->pushUs += micros() - start;
+  stream->bytes += stream->filled;
+}
+
+// True if the body ended in the middle of a header or rectangle
+bool display_stream_incomplete(const DisplayStream *stream)
+{
+  return stream->headerFill > 0 || (!stream->needHeader && stream->row < stream->h);
+}
+
+// Consumes the next piece of the body, returns false once the stream is invalid
+bool display_stream_write(DisplayStream *stream, const uint8_t *data, size_t length)
+{
+  while (length > 0 && !stream->failed)
+  {
+    if (stream->needHeader)
+    {
+      size_t n = min<size_t>(length, STREAM_HEADER_BYTES - stream->headerFill);
+      memcpy(stream->header + stream->headerFill, data, n);
+      stream->headerFill += n;
+      data += n;
+      length -= n;
+      if (stream->headerFill == STREAM_HEADER_BYTES)
+      {
+        const uint8_t *hdr = stream->header;
+        stream->x = hdr[0] | (hdr[1] << 8);
+        stream->y = hdr[2] | (hdr[3] << 8);
+        stream->w = hdr[4] | (hdr[5] << 8);
+        stream->h = hdr[6] | (hdr[7] << 8);
+        stream->failed = stream->w <= 0 || stream->h <= 0 || stream->x < 0 || stream->y < 0 ||
+                         stream->x + stream->w > TFT_WIDTH || stream->y + stream->h > TFT_HEIGHT;
+        stream->needHeader = false;
+        stream->headerFill = 0;
+        stream->row = 0;
+        stream->filled = 0;
+      }
+      continue;
+    }
+    if (stream->row >= stream->h)
+    {
+      stream->ignored += length;
+      return true;
+    }
+
+    int16_t rowsPerSegment = TFT_DRAW_SECTION / stream->w;
+    int16_t rows = min<int16_t>(rowsPerSegment, stream->h - stream->row);
+    uint32_t segmentBytes = (uint32_t)rows * stream->w * sizeof(uint16_t);
+    size_t n = min<size_t>(length, segmentBytes - stream->filled);
+    memcpy((uint8_t *)stream->pixels + stream->filled, data, n);
+    stream->filled += n;
+    data += n;
+    length -= n;
+
+    if (stream->filled == segmentBytes)
+    {
+      display_stream_push(stream, rows);
+      stream->row += rows;
+      stream->filled = 0;
+      if (stream->row == stream->h)
+      {
+        stream->frames++;
+        display_stream_frame();
+        stream->needHeader = stream->headers;
+      }
+    }
+  }
+  return !stream->failed;
+}
+
+#endif
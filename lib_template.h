@@ -0,0 +1,188 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+#include <vector>
+#include "lib_log.h"
+#include "lib_metrics.h"
+
+#define TEMPLATE_TEXT 0xFF    // part is static text
+#define TEMPLATE_UNKNOWN 0xFE // placeholder without a renderer, replaced by nothing
+#define TEMPLATE_VALUE_SIZE 256
+#define TEMPLATE_NAME_MAX 32
+
+struct TemplatePart
+{
+  const char *text; // static text, or the placeholder name
+  uint16_t length;
+  uint8_t variable; // index into the names given to parse(), or TEMPLATE_TEXT
+};
+
+// Writes piece `part` of a variable into buffer and returns its length, 0 once the variable is complete
+typedef std::function<size_t(uint8_t variable, size_t part, char *buffer, size_t size)> TemplateRenderer;
+
+/**
+ * A %NAME% template split once into static text and placeholder slots.
+ * The text is referenced, not copied, so it has to outlive the template.
+ */
+class PageTemplate
+{
+private:
+  std::vector<TemplatePart> parts;
+  size_t textLength = 0;
+
+public:
+  void parse(const char *text, const char *const names[], uint8_t count)
+  {
+    parts.clear();
+    textLength = 0;
+    const char *start = text;
+    const char *p = text;
+    while (*p)
+    {
+      const char *end = *p == '%' ? strchr(p + 1, '%') : nullptr;
+      bool placeholder = end && end - p - 1 > 0 && end - p - 1 <= TEMPLATE_NAME_MAX;
+      for (const char *c = p + 1; placeholder && c < end; c++)
+      {
+        placeholder = isalnum(*c) || *c == '_';
+      }
+      if (!placeholder)
+      {
+        p++;
+        continue;
+      }
+
+      if (p > start)
+      {
+        parts.push_back({start, (uint16_t)(p - start), TEMPLATE_TEXT});
+        textLength += p - start;
+      }
+      uint8_t variable = TEMPLATE_UNKNOWN;
+      for (uint8_t i = 0; i < count; i++)
+      {
+        if (strlen(names[i]) == (size_t)(end - p - 1) && strncmp(names[i], p + 1, end - p - 1) == 0)
+        {
+          variable = i;
+        }
+      }
+      parts.push_back({p + 1, (uint16_t)(end - p - 1), variable});
+      p = start = end + 1;
+    }
+    if (p > start)
+    {
+      parts.push_back({start, (uint16_t)(p - start), TEMPLATE_TEXT});
+      textLength += p - start;
+    }
+  }
+
+  size_t size() const { return parts.size(); }
+  const TemplatePart &operator[](size_t i) const { return parts[i]; }
+  // Bytes of static text, a lower bound for the rendered page
+  size_t staticLength() const { return textLength; }
+};
+
+// Position in a template while it is sent chunk by chunk, one per response
+class TemplateStream
+{
+private:
+  const PageTemplate &page;
+  TemplateRenderer render;
+  size_t part = 0;
+  size_t offset = 0;
+  size_t variablePart = 0;
+  char value[TEMPLATE_VALUE_SIZE];
+  size_t valueLength = 0;
+
+public:
+  TemplateStream(const PageTemplate &page, TemplateRenderer render) : page(page), render(render) {}
+
+  // Fills up to maxLen bytes, returns 0 once the page is complete
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t written = 0;
+    while (written < maxLen && part < page.size())
+    {
+      const TemplatePart &current = page[part];
+      const char *source = current.text;
+      size_t length = current.length;
+      if (current.variable != TEMPLATE_TEXT)
+      {
+        if (offset == valueLength)
+        {
+          valueLength = current.variable == TEMPLATE_UNKNOWN ? 0 : render(current.variable, variablePart++, value, sizeof(value));
+          offset = 0;
+          if (valueLength == 0)
+          {
+            part++;
+            variablePart = 0;
+            continue;
+          }
+        }
+        source = value;
+        length = valueLength;
+      }
+
+      size_t n = min(length - offset, maxLen - written);
+      memcpy(buffer + written, source + offset, n);
+      written += n;
+      offset += n;
+      if (current.variable == TEMPLATE_TEXT && offset == length)
+      {
+        part++;
+        offset = 0;
+      }
+    }
+    return written;
+  }
+};
+
+uint32_t fnv1a(const uint8_t *data, size_t length, uint32_t hash = 2166136261u)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Rewrites the file only if its content differs, saves a flash erase on every boot
+bool writeFileIfChanged(fs::FS &fs, const char *path, const char *content, size_t length)
+{
+  File file = fs.open(path);
+  if (file && file.size() == length)
+  {
+    uint8_t buffer[256];
+    uint32_t hash = 2166136261u;
+    size_t bytesRead;
+    while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0)
+    {
+      hash = fnv1a(buffer, bytesRead, hash);
+      metrics.fsReadBytes.add(bytesRead);
+    }
+    file.close();
+    if (hash == fnv1a((const uint8_t *)content, length))
+    {
+      return false;
+    }
+  }
+  else if (file)
+  {
+    file.close();
+  }
+
+  file = fs.open(path, "w");
+  if (!file)
+  {
+    LOG_ERROR("Failed to open file for writing: %s", path);
+    return false;
+  }
+  metrics.fsWriteBytes.add(file.write((const uint8_t *)content, length));
+  file.close();
+  LOG_INFO("Updated %s (%u bytes)", path, length);
+  return true;
+}
+
+#endif
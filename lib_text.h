@@ -0,0 +1,108 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <Arduino.h>
+#include <glcdfont.c> // classic 5x7 font of Adafruit GFX, 5 column bytes per character
+
+#define TEXT_GLYPH_WIDTH 6 // 5 font columns and one column of spacing
+#define TEXT_GLYPH_HEIGHT 8
+#define TEXT_CACHE_SLOTS 32
+#define TEXT_CACHE_BYTES (16 * 1024)
+
+// Bit `row` of the returned column is set if that pixel is lit, column 5 is always blank
+inline uint8_t text_font_column(uint8_t c, uint8_t column)
+{
+  return column < 5 ? pgm_read_byte(&font[c * 5 + column]) : 0;
+}
+
+// Renders a glyph scaled by sx/sy into a block of TEXT_GLYPH_WIDTH * sx by TEXT_GLYPH_HEIGHT * sy pixels
+void text_rasterize(uint16_t *block, uint8_t c, uint8_t sx, uint8_t sy, uint16_t fg, uint16_t bg)
+{
+  int16_t w = TEXT_GLYPH_WIDTH * sx;
+  for (uint8_t column = 0; column < TEXT_GLYPH_WIDTH; column++)
+  {
+    uint8_t bits = text_font_column(c, column);
+    for (uint8_t r = 0; r < TEXT_GLYPH_HEIGHT; r++, bits >>= 1)
+    {
+      uint16_t value = bits & 1 ? fg : bg;
+      for (uint8_t j = 0; j < sy; j++)
+      {
+        uint16_t *p = block + (r * sy + j) * w + column * sx;
+        for (uint8_t i = 0; i < sx; i++)
+        {
+          p[i] = value;
+        }
+      }
+    }
+  }
+}
+
+struct CachedGlyph
+{
+  uint8_t c, sx, sy;
+  uint16_t fg, bg;
+  uint16_t *pixels; // nullptr if the slot is empty
+
+  size_t bytes() const
+  {
+    return (size_t)TEXT_GLYPH_WIDTH * sx * TEXT_GLYPH_HEIGHT * sy * sizeof(uint16_t);
+  }
+};
+
+/**
+ * Direct mapped cache of rasterized glyphs keyed by character, scale and colors.
+ * Only opaque text is cached, transparent text needs the pixels underneath.
+ */
+class GlyphCache
+{
+private:
+  CachedGlyph slots[TEXT_CACHE_SLOTS];
+  size_t usedBytes;
+  uint32_t hitCount;
+  uint32_t missCount;
+
+public:
+  GlyphCache() : usedBytes(0), hitCount(0), missCount(0)
+  {
+    memset(slots, 0, sizeof(slots));
+  }
+
+  // Returns the glyph in the given colors, or nullptr if it does not fit the budget
+  const uint16_t *get(uint8_t c, uint8_t sx, uint8_t sy, uint16_t fg, uint16_t bg)
+  {
+    CachedGlyph &slot = slots[(c * 31u + sx * 7u + sy * 3u + fg + bg * 5u) % TEXT_CACHE_SLOTS];
+    if (slot.pixels && slot.c == c && slot.sx == sx && slot.sy == sy && slot.fg == fg && slot.bg == bg)
+    {
+      hitCount++;
+      return slot.pixels;
+    }
+    missCount++;
+
+    if (slot.pixels)
+    {
+      usedBytes -= slot.bytes();
+      free(slot.pixels);
+      slot.pixels = nullptr;
+    }
+    CachedGlyph glyph = {c, sx, sy, fg, bg, nullptr};
+    if (usedBytes + glyph.bytes() > TEXT_CACHE_BYTES)
+    {
+      return nullptr;
+    }
+    glyph.pixels = (uint16_t *)malloc(glyph.bytes());
+    if (!glyph.pixels)
+    {
+      return nullptr;
+    }
+    text_rasterize(glyph.pixels, c, sx, sy, fg, bg);
+    usedBytes += glyph.bytes();
+    slot = glyph;
+    return slot.pixels;
+  }
+
+  size_t bytes() const { return usedBytes; }
+  uint32_t hits() const { return hitCount; }
+  uint32_t misses() const { return missCount; }
+};
+
+#endif
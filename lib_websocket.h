@@ -0,0 +1,264 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include <esp_timer.h>
+#include <map>
+#include <string>
+
+#include "lib_log.h"
+#include "vm/instruction.h"
+#include "vm/vm.h"
+extern VM vm;
+
+#define WS_MAX_LINE 512          // longer command lines are dropped
+#define WS_MAX_MESSAGE 4096      // bytes per batch, larger batches are rejected as a whole
+#define WS_MAX_INSTRUCTIONS 256  // per batch
+#define WS_MESSAGE_SIZE 256
+#define WS_OUTBOX_SIZE 8         // "done" messages waiting to be sent
+
+/**
+ * Command channel on /vm/ws: every text message is one batch, lines are compiled as the frames arrive.
+ * The client gets an "ack" once the batch is queued and a "done" with the results once it ran,
+ * every client gets "queue" updates whenever the queue changed.
+ * Batches over WS_MAX_MESSAGE bytes or WS_MAX_INSTRUCTIONS instructions are not queued, their ack says "too_large".
+ *
+ * loop() never writes to the socket. It puts its messages into the outbox and starts a one-shot esp_timer,
+ * whose callback sends them right away from the esp_timer task. AsyncTCP hands the writes to the lwIP thread.
+ */
+AsyncWebSocket commandSocket("/vm/ws");
+
+struct CommandSession
+{
+  std::unique_ptr<Program> program;
+  std::string partial; // line split across frames
+  uint32_t batches = 0;
+  uint32_t bytes = 0; // of the current batch
+  uint16_t invalid = 0;
+  bool tooLarge = false;
+};
+// Only touched from the AsyncTCP task
+std::map<uint32_t, CommandSession> commandSessions;
+
+struct OutboxMessage
+{
+  uint32_t client;
+  char text[WS_MESSAGE_SIZE];
+};
+QueueHandle_t commandOutbox = nullptr;
+esp_timer_handle_t commandOutboxTimer = nullptr;
+std::atomic<bool> queueStatusPending(false);
+
+void websocket_send_queue_status()
+{
+  char message[WS_MESSAGE_SIZE];
+  snprintf(message, sizeof(message), "{\"type\":\"queue\",\"depth\":%u,\"capacity\":%u,\"high_water\":%u,\"dropped\":%u}",
+           vm.queueDepth(), vm.queueCapacity(), vm.queueHighWater(), vm.queueDrops());
+  if (commandSocket.count() > 0 && commandSocket.availableForWriteAll())
+  {
+    commandSocket.textAll(message);
+  }
+}
+
+// Rejects the whole batch, the rest of the message is skipped
+void websocket_reject_batch(CommandSession &session)
+{
+  LOG_WARN("Batch over %u bytes or %u instructions rejected", WS_MAX_MESSAGE, WS_MAX_INSTRUCTIONS);
+  session.tooLarge = true;
+  session.program.reset();
+  session.partial.clear();
+}
+
+void websocket_compile_line(CommandSession &session, std::string_view line)
+{
+  line = trimView(line);
+  if (line.empty() || session.tooLarge)
+  {
+    return;
+  }
+  if (session.program->count() >= WS_MAX_INSTRUCTIONS)
+  {
+    websocket_reject_batch(session);
+    return;
+  }
+  if (!compileInstruction(*session.program, line))
+  {
+    LOG_WARN("Invalid instruction: %.*s", (int)line.size(), line.data());
+    session.invalid++;
+  }
+}
+
+void websocket_submit(AsyncWebSocketClient *client, CommandSession &session)
+{
+  std::unique_ptr<Program> program = std::move(session.program);
+  uint32_t batch = ++session.batches;
+  uint16_t invalid = session.invalid;
+  uint16_t instructions = program ? program->count() : 0;
+  uint32_t bytes = session.bytes;
+  bool tooLarge = session.tooLarge;
+  session.invalid = 0;
+  session.bytes = 0;
+  session.tooLarge = false;
+
+  char message[WS_MESSAGE_SIZE];
+  if (tooLarge)
+  {
+    snprintf(message, sizeof(message),
+             "{\"type\":\"ack\",\"batch\":%u,\"status\":\"too_large\",\"bytes\":%u,\"max_bytes\":%u,\"max_instructions\":%u}",
+             batch, bytes, WS_MAX_MESSAGE, WS_MAX_INSTRUCTIONS);
+    client->text(message);
+    return;
+  }
+
+  const char *status = "empty";
+  if (instructions > 0)
+  {
+    program->tag(client->id(), batch);
+    status = vm.queue(std::move(program)) ? "queued" : "rejected";
+  }
+
+  snprintf(message, sizeof(message),
+           "{\"type\":\"ack\",\"batch\":%u,\"status\":\"%s\",\"instructions\":%u,\"invalid\":%u,\"queue_depth\":%u,\"queue_capacity\":%u}",
+           batch, status, instructions, invalid, vm.queueDepth(), vm.queueCapacity());
+  client->text(message);
+  websocket_send_queue_status();
+}
+
+void websocket_on_data(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len)
+{
+  if (info->message_opcode != WS_TEXT)
+  {
+    return;
+  }
+  CommandSession &session = commandSessions[client->id()];
+  // info->len is what the client announced for this frame, it only sizes the buffers up to the limit
+  session.bytes += len;
+  if (!session.tooLarge && (info->len > WS_MAX_MESSAGE || session.bytes > WS_MAX_MESSAGE))
+  {
+    websocket_reject_batch(session);
+  }
+  if (!session.program && !session.tooLarge)
+  {
+    session.program.reset(new Program());
+    session.program->reserve(min<uint64_t>(info->len, WS_MAX_MESSAGE));
+  }
+
+  std::string_view chunk((const char *)data, session.tooLarge ? 0 : len);
+  for (size_t newline; !session.tooLarge && (newline = chunk.find('\n')) != std::string_view::npos; chunk.remove_prefix(newline + 1))
+  {
+    if (session.partial.empty())
+    {
+      websocket_compile_line(session, chunk.substr(0, newline));
+    }
+    else
+    {
+      session.partial.append(chunk.data(), newline);
+      websocket_compile_line(session, session.partial);
+      session.partial.clear();
+    }
+  }
+  if (!session.tooLarge && session.partial.size() + chunk.size() <= WS_MAX_LINE)
+  {
+    session.partial.append(chunk.data(), chunk.size());
+  }
+  else if (!session.tooLarge)
+  {
+    LOG_WARN("Command line longer than %u bytes dropped", WS_MAX_LINE);
+    session.partial.clear();
+    session.invalid++;
+  }
+
+  // End of the last frame of the message
+  if (info->final && info->index + len == info->len)
+  {
+    websocket_compile_line(session, session.partial);
+    session.partial.clear();
+    websocket_submit(client, session);
+  }
+}
+
+// Runs in loop(), queues the message for the client that sent the batch and wakes the outbox timer to send it
+void websocket_on_program_complete(const ProgramResult &result)
+{
+  if (result.source != 0 && commandOutbox)
+  {
+    OutboxMessage message;
+    message.client = result.source;
+    snprintf(message.text, sizeof(message.text),
+             "{\"type\":\"done\",\"batch\":%u,\"status\":\"%s\",\"instructions\":%u,\"executed\":%u,\"queue_wait_us\":%u,\"duration_ms\":%u}",
+             result.batch, result.aborted ? "aborted" : "completed", result.instructions, result.executed, result.queueWaitUs, result.durationMs);
+    if (xQueueSend(commandOutbox, &message, 0) != pdTRUE)
+    {
+      LOG_WARN("WebSocket outbox full, result of batch %u dropped", result.batch);
+    }
+  }
+  queueStatusPending = true;
+  if (commandOutboxTimer)
+  {
+    esp_timer_start_once(commandOutboxTimer, 0); // already armed: that flush sends this message too
+  }
+}
+
+// esp_timer task, sends what loop() left in the outbox
+void websocket_flush_outbox()
+{
+  OutboxMessage message;
+  while (commandOutbox && xQueueReceive(commandOutbox, &message, 0) == pdTRUE)
+  {
+    if (commandSocket.availableForWrite(message.client))
+    {
+      commandSocket.text(message.client, message.text);
+    }
+  }
+  if (queueStatusPending.exchange(false))
+  {
+    websocket_send_queue_status();
+  }
+}
+
+void websocket_begin(AsyncWebServer &server)
+{
+  if (!commandOutbox)
+  {
+    commandOutbox = xQueueCreate(WS_OUTBOX_SIZE, sizeof(OutboxMessage));
+  }
+  if (!commandOutboxTimer)
+  {
+    esp_timer_create_args_t timer = {};
+    timer.callback = [](void *)
+    { websocket_flush_outbox(); };
+    timer.name = "ws_outbox";
+    if (esp_timer_create(&timer, &commandOutboxTimer) != ESP_OK)
+    {
+      LOG_ERROR("WebSocket outbox timer not available, results go out with the next socket event");
+      commandOutboxTimer = nullptr;
+    }
+  }
+  commandSocket.onEvent([](AsyncWebSocket *, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+                        {
+    if (!commandOutboxTimer)
+    {
+      websocket_flush_outbox();
+    }
+    switch (type)
+    {
+    case WS_EVT_CONNECT:
+      LOG_INFO("WebSocket client %u connected", client->id());
+      websocket_send_queue_status();
+      break;
+    case WS_EVT_DISCONNECT:
+      LOG_INFO("WebSocket client %u disconnected", client->id());
+      commandSessions.erase(client->id());
+      break;
+    case WS_EVT_DATA:
+      websocket_on_data(client, (AwsFrameInfo *)arg, data, len);
+      break;
+    default:
+      break;
+    } });
+  server.addHandler(&commandSocket);
+  vm.onComplete(websocket_on_program_complete);
+}
+
+#endif
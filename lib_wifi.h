@@ -9,15 +9,71 @@
 #include <NTPClient.h>
 #include <WiFiUdp.h>
 
+#include "lib_boot.h"
+#include "lib_catalog.h"
+#include "lib_config.h"
+#include "lib_metrics.h"
+#include "lib_slideshow.h"
+#include "lib_stream.h"
+#include "lib_template.h"
+#include "lib_websocket.h"
 #include "vm/instruction.h"
 #include "vm/vm.h"
 extern VM vm;
 
 #include "secrets.h"
 
+#define NTP_UPDATE_INTERVAL (60 * 60 * 1000)
+#define NTP_RETRY_INTERVAL (10 * 1000) // until the first successful update
+
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
 
+// Replaces timeClient.update() so every attempt ends up in the metrics
+void ntp_update()
+{
+    static uint32_t lastAttempt = 0;
+    static bool synced = false;
+    uint32_t interval = synced ? NTP_UPDATE_INTERVAL : NTP_RETRY_INTERVAL;
+    if (WiFi.status() != WL_CONNECTED || (lastAttempt != 0 && millis() - lastAttempt < interval))
+    {
+        return;
+    }
+    lastAttempt = millis();
+    uint32_t start = micros();
+    bool updated = timeClient.forceUpdate();
+    metrics.ntpLatency.observe(micros() - start);
+    (updated ? metrics.ntpSuccess : metrics.ntpFailure).add();
+    synced |= updated;
+    if (updated)
+    {
+        boot.mark("ntp_synced");
+    }
+    else
+    {
+        LOG_WARN("NTP update failed");
+    }
+}
+
+// Keeps NTP off loop(), a failed update blocks for up to a second
+void ntp_task(void *)
+{
+    bool connected = false;
+    for (;;)
+    {
+        if (WiFi.status() == WL_CONNECTED)
+        {
+            if (!connected)
+            {
+                boot.mark("wifi_connected");
+                connected = true;
+            }
+            ntp_update();
+        }
+        vTaskDelay(pdMS_TO_TICKS(connected ? 1000 : 100));
+    }
+}
+
 static const char *htmlContent PROGMEM = R"(
 <!DOCTYPE html>
 <html>
@@ -45,7 +101,7 @@ static const char *templateContent PROGMEM = R"(
     <h3>Uptime: %UPTIME% seconds</h3>
     <p>Current time: %TIME%</p>
     <p>Space left: %SPACE% bytes</p>
-    %FILES%
+    <ul>%FILES%</ul>
     <h2>Command</h2>
     <form action="/command">
         <textarea name="command" placeholder="Enter commands, one per line">
@@ -82,100 +138,267 @@ static const char *templateContent PROGMEM = R"(
 )";
 static const size_t templateContentLength = strlen_P(templateContent);
 
+enum IndexVariable
+{
+    INDEX_USER,
+    INDEX_UPTIME,
+    INDEX_TIME,
+    INDEX_SPACE,
+    INDEX_FILES,
+};
+static const char *const indexVariables[] = {"USER", "UPTIME", "TIME", "SPACE", "FILES"};
+static PageTemplate indexPage;
+
+// Renders the index page placeholders, %FILES% one list item per catalog entry
+size_t renderIndexVariable(uint8_t variable, size_t part, char *buffer, size_t size)
+{
+    int length = 0;
+    switch (variable)
+    {
+    case INDEX_USER:
+        length = part == 0 ? snprintf(buffer, size, "Timon") : 0;
+        break;
+    case INDEX_UPTIME:
+        length = part == 0 ? snprintf(buffer, size, "%lu", millis() / 1000) : 0;
+        break;
+    case INDEX_TIME:
+        length = part == 0 ? snprintf(buffer, size, "%s", timeClient.getFormattedTime().c_str()) : 0;
+        break;
+    case INDEX_SPACE:
+        length = part == 0 ? snprintf(buffer, size, "%u", catalog.freeBytes()) : 0;
+        break;
+    case INDEX_FILES:
+        catalog.with(part, [&](const CatalogEntry &entry)
+                     { length = snprintf(buffer, size, "<li><a href=\"/res%s\">%s (%u bytes)</a> <a href=\"/delete?file=%s\">(delete)</a></li>",
+                                         entry.path.c_str(), entry.path.c_str(), entry.size, entry.path.c_str()); });
+        break;
+    }
+    return min<size_t>(length, size - 1);
+}
+
+static const char *filesContent PROGMEM = R"({"total_bytes":%TOTAL%,"used_bytes":%USED%,"files":[%FILES%]})";
+
+enum FilesVariable
+{
+    FILES_TOTAL,
+    FILES_USED,
+    FILES_LIST,
+};
+static const char *const filesVariables[] = {"TOTAL", "USED", "FILES"};
+static PageTemplate filesPage;
+
+// Renders the JSON file listing, one object per catalog entry
+size_t renderFilesVariable(uint8_t variable, size_t part, char *buffer, size_t size)
+{
+    int length = 0;
+    switch (variable)
+    {
+    case FILES_TOTAL:
+        length = part == 0 ? snprintf(buffer, size, "%u", catalog.total()) : 0;
+        break;
+    case FILES_USED:
+        length = part == 0 ? snprintf(buffer, size, "%u", catalog.used()) : 0;
+        break;
+    case FILES_LIST:
+        catalog.with(part, [&](const CatalogEntry &entry)
+                     {
+            length = snprintf(buffer, size, "%s{\"path\":\"", part ? "," : "");
+            // Paths come from upload requests, escape what would end the string
+            for (const char *c = entry.path.c_str(); *c && length < (int)size - 2; c++)
+            {
+                if (*c == '"' || *c == '\\')
+                {
+                    buffer[length++] = '\\';
+                }
+                buffer[length++] = *c;
+            }
+            length += snprintf(buffer + length, size - length, "\",\"size\":%u,\"mtime\":%ld}", entry.size, (long)entry.mtime); });
+        break;
+    }
+    return min<size_t>(length, size - 1);
+}
+
+// Sends a parsed template as chunked response, rendering the placeholders with `render`
+void sendTemplate(AsyncWebServerRequest *request, const char *contentType, const PageTemplate &page, TemplateRenderer render)
+{
+    uint32_t start = micros();
+    String url = request->url();
+    std::shared_ptr<TemplateStream> stream = std::make_shared<TemplateStream>(page, render);
+    request->send(request->beginChunkedResponse(
+        contentType,
+        [stream, start, url](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+        {
+            size_t length = stream->fill(buffer, maxLen);
+            if (length == 0)
+            {
+                LOG_DEBUG("%s: %u bytes in %luus", url.c_str(), index, micros() - start);
+            }
+            return length;
+        }));
+}
+
 static AsyncWebServer server(80);
 
-void string_split(const String &str, char delimiter, std::function<void(const String &)> callback)
+long requestIntParam(AsyncWebServerRequest *request, const char *name, long fallback)
+{
+    return request->hasParam(name) ? request->getParam(name)->value().toInt() : fallback;
+}
+
+// Rendered in place, a second scrape is turned away until the first one was sent
+static char metricsBuffer[METRICS_BUFFER_SIZE];
+static std::atomic<bool> metricsBusy(false);
+
+size_t renderMetrics(char *buffer, size_t size)
 {
-    int start = 0;
-    int end = str.indexOf(delimiter);
-    while (end != -1)
+    MetricsWriter out(buffer, size);
+
+    out.describe("esp_heap_free_bytes", "gauge", "Free heap");
+    out.value("esp_heap_free_bytes", ESP.getFreeHeap());
+    out.describe("esp_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    out.value("esp_heap_min_free_bytes", ESP.getMinFreeHeap());
+    out.describe("esp_heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated");
+    out.value("esp_heap_largest_free_block_bytes", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    out.describe("esp_uptime_seconds", "counter", "Seconds since boot");
+    out.value("esp_uptime_seconds", millis() / 1000);
+
+    out.describe("loop_iteration_seconds", "histogram", "Time loop() spends per iteration before it waits");
+    out.histogram("loop_iteration_seconds", metrics.loop);
+
+    out.describe("display_frame_seconds", "histogram", "Time to draw a picture from flash");
+    out.histogram("display_frame_seconds", metrics.frame);
+    out.describe("frame_cache_hits_total", "counter", "Pictures found in the frame cache");
+    out.value("frame_cache_hits_total", frame_cache.hits());
+    out.describe("frame_cache_misses_total", "counter", "Pictures read from flash");
+    out.value("frame_cache_misses_total", frame_cache.misses());
+    out.describe("frame_cache_evictions_total", "counter", "Frames dropped for space or because the file changed");
+    out.value("frame_cache_evictions_total", frame_cache.evictions());
+    out.describe("frame_cache_bytes", "gauge", "Memory held by cached frames");
+    out.value("frame_cache_bytes", frame_cache.used());
+    out.describe("frame_cache_budget_bytes", "gauge", "Memory the frame cache may use");
+    out.value("frame_cache_budget_bytes", frame_cache.capacity());
+    out.describe("slideshow_frames_shown_total", "counter", "Playlist frames shown since the playlist started");
+    out.value("slideshow_frames_shown_total", slideshow.shown());
+    out.describe("slideshow_frames_dropped_total", "counter", "Playlist frames skipped because they were already overdue");
+    out.value("slideshow_frames_dropped_total", slideshow.dropped());
+    out.describe("slideshow_lateness_seconds", "histogram", "How late shown playlist frames started");
+    out.histogram("slideshow_lateness_seconds", slideshow.latenessHistogram());
+    out.describe("display_stream_frames_total", "counter", "Rectangles streamed to the panel over HTTP");
+    out.value("display_stream_frames_total", display_stream_meter.frames);
+
+    out.describe("vm_queue_depth", "gauge", "Programs waiting in the VM queue");
+    out.value("vm_queue_depth", vm.queueDepth());
+    out.describe("vm_queue_capacity", "gauge", "Programs the VM queue can hold");
+    out.value("vm_queue_capacity", vm.queueCapacity());
+    out.describe("vm_queue_pushed_total", "counter", "Programs queued");
+    out.value("vm_queue_pushed_total", vm.queuePushes());
+    out.describe("vm_queue_dropped_total", "counter", "Programs rejected, evicted or timed out");
+    out.value("vm_queue_dropped_total", vm.queueDrops());
+
+    out.describe("http_handler_seconds", "histogram", "Time spent in the request handler per route, excluding upload and body callbacks");
+    for (uint8_t i = 0; i < metrics.routeCount; i++)
     {
-        callback(str.substring(start, end));
-        start = end + 1;
-        end = str.indexOf(delimiter, start);
+        char labels[64];
+        snprintf(labels, sizeof(labels), "route=\"%s\"", metrics.routes[i].path);
+        out.histogram("http_handler_seconds", metrics.routes[i].latency, labels);
     }
-    callback(str.substring(start));
+
+    out.describe("fs_read_bytes_total", "counter", "Bytes read from LittleFS, static files excluded");
+    out.value("fs_read_bytes_total", metrics.fsReadBytes.get());
+    out.describe("fs_write_bytes_total", "counter", "Bytes written to LittleFS");
+    out.value("fs_write_bytes_total", metrics.fsWriteBytes.get());
+    out.describe("fs_used_bytes", "gauge", "Used LittleFS bytes, estimated per block");
+    out.value("fs_used_bytes", catalog.used());
+    out.describe("fs_total_bytes", "gauge", "LittleFS size");
+    out.value("fs_total_bytes", catalog.total());
+
+    out.describe("ntp_updates_total", "counter", "NTP updates by result");
+    out.value("ntp_updates_total", metrics.ntpSuccess.get(), "result=\"success\"");
+    out.value("ntp_updates_total", metrics.ntpFailure.get(), "result=\"failure\"");
+    out.describe("ntp_update_seconds", "histogram", "Time an NTP update took");
+    out.histogram("ntp_update_seconds", metrics.ntpLatency);
+
+    out.describe("boot_phase_seconds", "gauge", "When each boot phase was reached, since the app started");
+    BootPhase phases[BOOT_PHASES];
+    uint8_t phaseCount = boot.snapshot(phases, BOOT_PHASES);
+    for (uint8_t i = 0; i < phaseCount; i++)
+    {
+        char seconds[24];
+        MetricsWriter::formatSeconds(seconds, sizeof(seconds), phases[i].us);
+        out.printf("boot_phase_seconds{phase=\"%s\"} %s\n", phases[i].name, seconds);
+    }
+
+    out.describe("log_dropped_total", "counter", "Log lines dropped because the ring was full");
+    out.value("log_dropped_total", log_ring.dropped.load());
+
+    if (out.truncated())
+    {
+        LOG_ERROR("Metrics do not fit into %u bytes", size);
+        return 0;
+    }
+    return out.length();
 }
 
+// Registers a route, the time spent in its request handler goes into the route latency histogram
+AsyncCallbackWebHandler &server_on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                   ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr)
+{
+    MetricHistogram *latency = metrics.route(uri);
+    if (latency)
+    {
+        onRequest = [latency, onRequest](AsyncWebServerRequest *request)
+        {
+            uint32_t start = micros();
+            onRequest(request);
+            latency->observe(micros() - start);
+        };
+    }
+    return server.on(uri, method, onRequest, onUpload, onBody);
+}
+
+// Uploads are written one at a time, the request owning the writer is kept to abort it on disconnect
+static UploadWriter upload;
+static AsyncWebServerRequest *uploadRequest = nullptr;
+
 void server_begin()
 {
 #ifdef FEATURE_FS
+    // Still served below /res/, the index page itself is rendered from RAM
+    if (writeFileIfChanged(SPIFFS, "/template.html", templateContent, templateContentLength))
     {
-        File f = SPIFFS.open("/template.html", "w");
-        assert(f);
-        f.print(templateContent);
-        f.close();
+        catalog.update("/template.html");
     }
 
     server.serveStatic("/res/", SPIFFS, "/")
         .setDefaultFile("index.html");
 #endif
 
-    server.on("/lorem.html", HTTP_GET, [](AsyncWebServerRequest *request)
+    server_on("/lorem.html", HTTP_GET, [](AsyncWebServerRequest *request)
               {
     // need to cast to uint8_t*
     // if you do not, the const char* will be copied in a temporary String buffer
     request->send(200, "text/html", (uint8_t *)htmlContent, htmlContentLength); });
 
     server.rewrite("/", "/index.html");
-    server.on(
+    indexPage.parse(templateContent, indexVariables, sizeof(indexVariables) / sizeof(indexVariables[0]));
+    server_on(
         "/index.html", HTTP_GET,
         [](AsyncWebServerRequest *request)
-        { request->send(SPIFFS, "/template.html", "text/html", false, [](const String &var) -> String
-                        {
-      if (var == "USER") {
-        return String("Timon");
-      } else if (var == "UPTIME") {
-        return String( millis() / 1000 );
-      } else if (var == "TIME") {
-        return timeClient.getFormattedTime();
-      } else if (var == "SPACE") {
-        return String(getFreeSpace(SPIFFS));
-      } else if(var == "FILES") {
-        static String filesList;
-        filesList = "<ul>";
-        // Helper function to accumulate file list
-        void (*fileListCallback)(File &) = [](File &file) {
-            if (!file.isDirectory()) {
-                filesList += "<li>";
-
-                filesList += "<a href=\"/res";
-                filesList += file.path();
-                filesList += "\">";
-
-                filesList += file.path();
-
-                filesList += " (";
-                filesList += file.size();
-                filesList += " bytes)";
-                filesList += "</a>";
-
-                filesList += " <a href=\"/delete?file=";
-                filesList += file.path();
-                filesList += "\">(delete)</a>";
-
-                filesList += "</li>";
-            }
-        };
-        listDirCallback(SPIFFS, "/", fileListCallback);
-        filesList += "</ul>";
-        return filesList;
-      }
-
+        { sendTemplate(request, "text/html", indexPage, renderIndexVariable); });
 
-      return emptyString; }); });
+    filesPage.parse(filesContent, filesVariables, sizeof(filesVariables) / sizeof(filesVariables[0]));
+    server_on(
+        "/files", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        { sendTemplate(request, "application/json", filesPage, renderFilesVariable); });
 
-    server.on(
+    server_on(
         "/command", HTTP_GET,
         [](AsyncWebServerRequest *request)
         {
-            Serial.printf("Received GET request for URL: %s\n", request->url());
+            LOG_DEBUG("Received GET request for URL: %s", request->url().c_str());
 
-            String command;
-            if (request->hasParam("command"))
-            {
-                command = request->getParam("command")->value();
-            }
+            // Parsed in place, the parameter outlives the handler
+            const String &command = request->hasParam("command") ? request->getParam("command")->value() : emptyString;
             if (command.isEmpty())
             {
                 String response = "{";
@@ -186,32 +409,189 @@ void server_begin()
             }
             else
             {
-                string_split(command, '\n',
-                             [](const String &line)
-                             {
-                                 if (!line.isEmpty())
-                                 {
-                                     Instruction *instruction = instructionFromString(line);
-                                     if (instruction)
-                                     {
-                                         vm.queue(std::unique_ptr<Instruction>(instruction));
-                                     }
-                                     else
-                                     {
-                                         Serial.printf("Invalid instruction: %s\n", line.c_str());
-                                     }
-                                 }
-                             });
-                request->send(200, "application/json", "{\"status\":\"OK\"}");
+                std::unique_ptr<Program> program(new Program());
+                program->reserve(command.length());
+                splitView(std::string_view(command.c_str(), command.length()), '\n',
+                          [&program](std::string_view line)
+                          {
+                              if (!line.empty() && !program->overflowed())
+                              {
+                                  if (!compileInstruction(*program, line))
+                                  {
+                                      LOG_WARN("Invalid instruction: %.*s", (int)line.size(), line.data());
+                                  }
+                              }
+                          });
+                if (program->overflowed())
+                {
+                    String response = "{";
+                    response += "\"status\":\"Error\",";
+                    response += "\"message\":\"Program too large\",";
+                    response += "\"max_instructions\":" + String(PROGRAM_MAX_INSTRUCTIONS) + ",";
+                    response += "\"max_string_bytes\":" + String(PROGRAM_MAX_POOL);
+                    response += "}";
+                    request->send(413, "application/json", response);
+                }
+                else if (vm.queue(std::move(program)))
+                {
+                    request->send(200, "application/json", "{\"status\":\"OK\"}");
+                }
+                else
+                {
+                    String response = "{";
+                    response += "\"status\":\"Error\",";
+                    response += "\"message\":\"VM queue full\",";
+                    response += "\"queue_depth\":" + String(vm.queueDepth()) + ",";
+                    response += "\"queue_capacity\":" + String(vm.queueCapacity());
+                    response += "}";
+                    // 503 if the queue did not drain within the blocking timeout, 429 if it rejects right away
+                    int code = VM_QUEUE_POLICY == OverflowPolicy::BLOCK ? 503 : 429;
+                    AsyncWebServerResponse *queueFull = request->beginResponse(code, "application/json", response);
+                    queueFull->addHeader("Retry-After", "1");
+                    request->send(queueFull);
+                }
+            }
+        });
+
+    server_on(
+        "/vm/queue", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            String response = "{";
+            response += "\"depth\":" + String(vm.queueDepth()) + ",";
+            response += "\"capacity\":" + String(vm.queueCapacity()) + ",";
+            response += "\"high_water\":" + String(vm.queueHighWater()) + ",";
+            response += "\"pushed\":" + String(vm.queuePushes()) + ",";
+            response += "\"dropped\":" + String(vm.queueDrops());
+            response += "}";
+            request->send(200, "application/json", response);
+        });
+
+    // Big endian RGB565 straight to the panel, without w and h each rectangle starts with x, y, w, h as little endian uint16
+    // curl -H "Content-Type: application/octet-stream" --data-binary @data/test.raw "http://192.168.1.38/display?w=320&h=170"
+    server_on(
+        "/display", HTTP_POST,
+        [](AsyncWebServerRequest *request)
+        {
+            DisplayStream *stream = (DisplayStream *)request->_tempObject;
+            if (!stream)
+            {
+                request->send(400, "application/json", "{\"status\":\"Error\",\"message\":\"No pixels received\"}");
+                return;
+            }
+            bool complete = !stream->failed && !display_stream_incomplete(stream);
+            char response[192];
+            snprintf(response, sizeof(response),
+                     "{\"status\":\"%s\",\"frames\":%u,\"bytes\":%u,\"ignored\":%u,\"push_us\":%u,\"total_us\":%lu,\"fps\":%u.%02u}",
+                     complete ? "OK" : "Error", stream->frames, stream->bytes, stream->ignored, stream->pushUs,
+                     micros() - stream->startedAt, display_stream_meter.fps100 / 100, display_stream_meter.fps100 % 100);
+            LOG_DEBUG("Display stream: %s", response);
+            request->send(complete ? 200 : 400, "application/json", response);
+        },
+        nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+        {
+            if (index == 0 && !request->_tempObject)
+            {
+                bool headers = !request->hasParam("w") || !request->hasParam("h");
+                request->_tempObject = display_stream_begin(headers, requestIntParam(request, "x", 0), requestIntParam(request, "y", 0),
+                                                            requestIntParam(request, "w", 0), requestIntParam(request, "h", 0));
+                if (!request->_tempObject)
+                {
+                    LOG_ERROR("No memory for a display stream");
+                }
+            }
+            if (request->_tempObject)
+            {
+                display_stream_write((DisplayStream *)request->_tempObject, data, len);
+            }
+        });
+
+    // Prometheus text format, curl http://192.168.1.38/metrics
+    server_on(
+        "/metrics", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            if (metricsBusy.exchange(true))
+            {
+                AsyncWebServerResponse *busy = request->beginResponse(503, "text/plain", "Scrape in progress");
+                busy->addHeader("Retry-After", "1");
+                request->send(busy);
+                return;
             }
+            request->onDisconnect([]()
+                                  { metricsBusy = false; });
+            size_t length = renderMetrics(metricsBuffer, sizeof(metricsBuffer));
+            if (length == 0)
+            {
+                request->send(500, "text/plain", "Metrics buffer too small");
+                return;
+            }
+            // Sent straight from the buffer, without a copy
+            request->send_P(200, "text/plain; version=0.0.4", (const uint8_t *)metricsBuffer, length);
+        });
+
+    // curl http://192.168.1.38/vm/stats, add ?reset=1 to start over
+    server_on(
+        "/vm/stats", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            String response;
+            response.reserve(2048);
+            response += "{\"profile\":";
+            vm.stats().appendJson(response);
+            response += ",\"optimizer\":{";
+            response += "\"instructions_removed\":" + String(vm.optimizerInstructionsRemoved()) + ",";
+            response += "\"spi_bytes_saved\":" + String(vm.optimizerSpiBytesSaved());
+            response += "}}";
+            if (request->hasParam("reset"))
+            {
+                vm.stats().reset();
+            }
+            request->send(200, "application/json", response);
+        });
+
+    // Playlist progress, target and achieved frame rate and how late frames started
+    server_on(
+        "/slideshow", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            String response;
+            response.reserve(256);
+            slideshow.appendJson(response);
+            request->send(200, "application/json", response);
+        });
+
+    // Boot phase timestamps in microseconds since the app started
+    server_on(
+        "/boot", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            String response;
+            response.reserve(512);
+            boot.appendJson(response);
+            request->send(200, "application/json", response);
+        });
+
+    // Most recent log lines, the counters cover everything since boot
+    server_on(
+        "/log", HTTP_GET,
+        [](AsyncWebServerRequest *request)
+        {
+            String response;
+            response.reserve(LOG_TAIL_LINES * 64);
+            response += "# written=" + String(log_ring.written.load()) + " dropped=" + String(log_ring.dropped.load()) +
+                        " truncated=" + String(log_ring.truncated.load()) + "\n";
+            log_tail_append(response);
+            request->send(200, "text/plain", response);
         });
 
     // curl -v -H "Content-Type: application/x-www-form-urlencoded" -d "file=offset" -d "data=10" http://192.168.1.38/update
-    server.on(
+    server_on(
         "/update", HTTP_GET,
         [](AsyncWebServerRequest *request)
         {
-            Serial.printf("Received POST request for URL: %s\n", request->url());
+            LOG_DEBUG("Received POST request for URL: %s", request->url().c_str());
 
             String file;
             if (request->hasParam("file"))
@@ -233,16 +613,30 @@ void server_begin()
                 response += "}";
                 request->send(400, "application/json", response);
             }
+            else if (config.contains(file.c_str()))
+            {
+                // Written through by the config store, unchanged values are not written at all
+                if (config.set(file.c_str(), data))
+                {
+                    request->send(200, "application/json", "{\"status\":\"OK\"}");
+                }
+                else
+                {
+                    request->send(400, "application/json", "{\"status\":\"Error\",\"message\":\"Invalid value\"}");
+                }
+            }
             else
             {
                 writeFile(SPIFFS, file.c_str(), data.c_str());
+                catalog.update(file);
                 request->send(200, "application/json", "{\"status\":\"OK\"}");
             }
             // onNotFound will always be called after this, and will not override the response object if `/game_log` is requested
         });
 
     // curl -v -F "data=@starter.ino" http://192.168.1.38/upload?file=starter.ino
-    server.on(
+    // add &length=<bytes>&crc=<crc32 hex> to only replace the file if the upload arrived intact
+    server_on(
         "/upload", HTTP_POST,
         [](AsyncWebServerRequest *request)
         {
@@ -273,28 +667,55 @@ void server_begin()
                 file = request->getParam("file")->value();
             }
 
-            Serial.printf("Upload[local: %s, esp: %s]: start=%u, len=%u, final=%d\n", filename.c_str(), file.c_str(), index, len, final);
+            LOG_DEBUG("Upload[local: %s, esp: %s]: start=%u, len=%u, final=%d", filename.c_str(), file.c_str(), index, len, final);
 
             if (!index)
             {
-                request->_tempFile = SPIFFS.open(file, "w");
-
-                if (!request->_tempFile)
+                if (upload.isActive())
+                {
+                    request->send(409, "text/plain", "Another upload is in progress: " + upload.target());
+                    return;
+                }
+                if (!upload.begin(SPIFFS, file))
                 {
                     request->send(400, "text/plain", "File not available for writing: " + file);
+                    return;
                 }
+                uploadRequest = request;
+                request->onDisconnect([request]()
+                                      {
+                    if (uploadRequest == request)
+                    {
+                        upload.abort();
+                        uploadRequest = nullptr;
+                    } });
+            }
+            if (uploadRequest != request)
+            {
+                return;
             }
             if (len)
             {
-                request->_tempFile.write(data, len);
+                upload.write(data, len);
             }
             if (final)
             {
-                request->_tempFile.close();
+                uploadRequest = nullptr;
+                uint32_t length = request->hasParam("length") ? request->getParam("length")->value().toInt() : 0;
+                uint32_t crc = request->hasParam("crc") ? strtoul(request->getParam("crc")->value().c_str(), nullptr, 16) : 0;
+                if (upload.finish(length, crc))
+                {
+                    catalog.update(file);
+                    config.reload(file.c_str());
+                }
+                else
+                {
+                    request->send(400, "text/plain", "Upload failed or did not match length/crc: " + file);
+                }
             }
         });
 
-    server.on("/delete", HTTP_GET,
+    server_on("/delete", HTTP_GET,
               [](AsyncWebServerRequest *request)
               {
                   String file;
@@ -306,6 +727,8 @@ void server_begin()
                   {
                       if (SPIFFS.remove(file))
                       {
+                          catalog.remove(file);
+                          config.reload(file.c_str());
                           request->send(200, "text/plain", "File deleted successfully");
                       }
                       else
@@ -319,11 +742,11 @@ void server_begin()
                   }
               });
 
-    server.on(
+    server_on(
         "/reboot", HTTP_GET,
         [](AsyncWebServerRequest *request)
         {
-            Serial.println("Rebooting...");
+            LOG_WARN("Rebooting...");
             request->send(200, "text/plain", "Rebooting...");
             delay(1000);
             ESP.restart();
@@ -336,33 +759,38 @@ void server_begin()
     // }
     // request->send(404, "text/plain", "Not found"); });
 
+    websocket_begin(server);
     server.begin();
 }
 
-void wifi_setup()
+// Starts associating in the background, called before the display and filesystem come up
+void wifi_begin()
 {
 #ifdef FEATURE_WIFI
     WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
     WiFi.setHostname(hostname);
     WiFi.begin(ssid, password);
+#endif
+}
 
-    int offset = 2;
-    {
-        String offsetVal;
-        readFileToString(SPIFFS, "/offset", offsetVal);
-        if (-20 < offsetVal.toInt() && offsetVal.toInt() < 20)
-        {
-            offset = offsetVal.toInt();
-        }
-        else
+// Needs the filesystem, does not wait for the connection
+void wifi_setup()
+{
+#ifdef FEATURE_WIFI
+    timeClient.setTimeOffset(3600 * config.getInt("offset"));
+    config.onChange([](const char *key)
+                    {
+        if (strcmp(key, "offset") == 0)
         {
-            Serial.printf(F("Invalid offset value: %s\n"), offsetVal.c_str());
-        }
-    }
-    timeClient.setTimeOffset(3600 * offset);
+            timeClient.setTimeOffset(3600 * config.getInt("offset"));
+        } });
 
-    timeClient.setUpdateInterval(60 * 60 * 1000);
+    timeClient.setUpdateInterval(NTP_UPDATE_INTERVAL);
     timeClient.begin();
+    if (xTaskCreate(ntp_task, "ntp", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr) != pdPASS)
+    {
+        LOG_ERROR("NTP task not available, time will not be set");
+    }
 
     server_begin();
 #endif
@@ -8,55 +8,156 @@
 #include "global.h"
 
 
+#define DEBUG_INFO_MS 5000 // IP and time stay on screen this long once WiFi is connected
+
+// Set by show_debugging_info(), loop() keeps the background off the screen until then
+static uint32_t debugInfoUntil = 0;
+
+// Set by the listeners, loop() only looks at the background and playlist once they changed
+static std::atomic<bool> backgroundChanged(true);
+static std::atomic<bool> playlistChanged(true);
+
+void on_config_change(const char *key)
+{
+  if (strcmp(key, "background") == 0)
+  {
+    backgroundChanged = true;
+  }
+  else if (strcmp(key, "playlist") == 0)
+  {
+    playlistChanged = true;
+  }
+}
+
+// A new upload of the playlist file restarts it
+void on_file_change(const String &path)
+{
+  if (path == config.getString("playlist"))
+  {
+    playlistChanged = true;
+  }
+}
+
 void setup(void)
 {
+  boot.mark("setup");
   Serial.begin(460800);
   while (!Serial) // Wait for Serial to be ready
   {
     delay(10);
   }
   Serial.println();
+  log_setup();
 
   Serial.print(F("setup() running on core "));
   Serial.println(xPortGetCoreID());
 
+  // The framebuffer is taken first, then association runs while the display and filesystem come up
+  display_allocate();
+  boot.mark("framebuffer");
+  wifi_begin();
+  boot.mark("wifi_begin");
   display_setup();
+  boot.mark("display");
+#ifdef FEATURE_TEXT_BENCHMARK
+  display_text_benchmark();
+#endif
   fs_setup();
+  boot.mark("fs");
+  catalog.begin(SPIFFS);
+  boot.mark("catalog");
+  config.begin(SPIFFS);
+  config.onChange(on_config_change);
+  catalog.onChange(on_file_change);
+  boot.mark("config");
+  slideshow.begin();
+  vm.begin();
   wifi_setup();
+  boot.mark("server");
 
   Serial.println(F("Initialized"));
-
-  show_debugging_info();
 }
 
 void loop()
 {
-  Serial.println(F("loop"));
+  LOG_DEBUG("loop");
+  uint32_t loopStart = micros();
 
 #ifdef FEATURE_WIFI
-  timeClient.update();
+  static bool debugInfoShown = false;
+  if (!debugInfoShown && WiFi.status() == WL_CONNECTED)
+  {
+    show_debugging_info();
+    debugInfoShown = true;
+  }
+  commandSocket.cleanupClients();
 #endif
 
   vm.run();
 
-  String path;
-  readFileToString(SPIFFS, "/background", path);
-  display_picture(path);
+  // Only redraw the background if it changed or something was drawn over it,
+  // but leave the screen alone while a program waits in a delay
+  static String path;
+  static uint32_t shownGeneration = 0;
+  static bool backgroundStale = true;
+  if (backgroundChanged.exchange(false))
+  {
+    path = config.getString("background");
+    backgroundStale = true;
+  }
+  if (playlistChanged.exchange(false) && !slideshow.start(SPIFFS, config.getString("playlist")))
+  {
+    backgroundStale = true; // stopped, show the background again
+  }
+  uint32_t debugInfoLeft = 0;
+  if (debugInfoUntil != 0)
+  {
+    int32_t left = debugInfoUntil - millis();
+    debugInfoLeft = left > 0 ? left : 0;
+    debugInfoUntil = left > 0 ? debugInfoUntil : 0;
+  }
+  uint32_t nextFrameIn = UINT32_MAX;
+  if (vm.isIdle() && debugInfoLeft == 0 && slideshow.isActive())
+  {
+    nextFrameIn = slideshow.tick();
+    boot.mark("first_frame");
+  }
+  else if (vm.isIdle() && debugInfoLeft == 0 &&
+           (backgroundStale || display.generation() != shownGeneration))
+  {
+    display_picture(path);
+    boot.mark("first_frame");
+    shownGeneration = display.generation();
+    backgroundStale = false;
+  }
 
-  delay_display(10 * 1000);
+  // Wait for the next refresh, delay or playlist frame, but wake up as soon as a command batch is queued
+  uint32_t wait = min<uint32_t>(min<uint32_t>(10 * 1000, vm.nextWakeIn()), nextFrameIn);
+  if (debugInfoLeft > 0)
+  {
+    wait = min(wait, debugInfoLeft);
+  }
+#ifdef FEATURE_WIFI
+  if (!debugInfoShown)
+  {
+    wait = min<uint32_t>(wait, 250); // pick up the connection quickly
+  }
+#endif
+  metrics.loop.observe(micros() - loopStart);
+  delay_display(wait, [](uint32_t ms)
+                { return vm.waitForWork(ms); });
 }
 
+// Drawn straight to the panel once, loop() redraws the background after DEBUG_INFO_MS
 void show_debugging_info()
 {
-  for (int i = 0; i < 5; i++)
-  {
 #ifdef FEATURE_WIFI
-    timeClient.update();
-
-    Serial.print(F("Wlan connection: "));
-    Serial.println(WiFi.status());
-    Serial.println(timeClient.getFormattedTime());
+  Serial.print(F("Wlan connection: "));
+  Serial.println(WiFi.status());
+  Serial.println(timeClient.getFormattedTime());
 
+  {
+    DisplayLock lock;
     tft.fillScreen(ST77XX_GREEN);
     tft.setTextSize(2);
     tft.setTextColor(ST77XX_BLUE);
@@ -68,7 +169,7 @@ void show_debugging_info()
     tft.setCursor(20, tft.getCursorY());
     tft.print(F("Now: "));
     tft.println(timeClient.getFormattedTime());
-#endif
-    delay(1000);
   }
-}
\ No newline at end of file
+  debugInfoUntil = millis() + DEBUG_INFO_MS;
+#endif
+}
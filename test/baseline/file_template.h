@@ -0,0 +1,86 @@
+// The index page before PageTemplate, kept for the benchmarks: /template.html is read from flash on every request and
+// scanned for %NAME%, the processor returns a String per placeholder and %FILES% walks the directories into one String.
+#pragma once
+#include "../../global.h"
+
+namespace baseline
+{
+
+String indexProcessor(const String &var)
+{
+    if (var == "USER")
+    {
+        return String("Timon");
+    }
+    else if (var == "UPTIME")
+    {
+        return String(millis() / 1000);
+    }
+    else if (var == "TIME")
+    {
+        return timeClient.getFormattedTime();
+    }
+    else if (var == "SPACE")
+    {
+        return String(SPIFFS.totalBytes() - SPIFFS.usedBytes());
+    }
+    else if (var == "FILES")
+    {
+        static String filesList;
+        filesList = "<ul>";
+        void (*fileListCallback)(File &) = [](File &file)
+        {
+            if (!file.isDirectory())
+            {
+                filesList += "<li>";
+                filesList += "<a href=\"/res";
+                filesList += file.path();
+                filesList += "\">";
+                filesList += file.path();
+                filesList += " (";
+                filesList += (unsigned)file.size();
+                filesList += " bytes)";
+                filesList += "</a>";
+                filesList += " <a href=\"/delete?file=";
+                filesList += file.path();
+                filesList += "\">(delete)</a>";
+                filesList += "</li>";
+            }
+        };
+        listDirCallback(SPIFFS, "/", fileListCallback);
+        filesList += "</ul>";
+        return filesList;
+    }
+    return emptyString;
+}
+
+// What request->send(SPIFFS, "/template.html", "text/html", false, processor) produced, read in TCP sized chunks
+void sendFileTemplate(AsyncWebServerRequest *request)
+{
+    File file = SPIFFS.open("/template.html", "r");
+    String page;
+    char chunk[1436];
+    for (size_t n; (n = file.read((uint8_t *)chunk, sizeof(chunk))) > 0;)
+    {
+        page.concat(chunk, n);
+    }
+    file.close();
+
+    String body;
+    for (int at = 0; at < (int)page.length();)
+    {
+        int open = page.indexOf('%', at);
+        int close = open < 0 ? -1 : page.indexOf('%', open + 1);
+        if (close < 0)
+        {
+            body += page.substring(at);
+            break;
+        }
+        body += page.substring(at, open);
+        body += indexProcessor(page.substring(open + 1, close));
+        at = close + 1;
+    }
+    request->send(200, "text/html", body);
+}
+
+} // namespace baseline
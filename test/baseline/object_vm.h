@@ -0,0 +1,244 @@
+// The command path before the bytecode VM, kept for the benchmarks: one heap object per line, found with a strcmp chain
+// and parsed through String copies. Trimmed to the instructions the benchmark scripts use, execute() draws on the
+// same FrameBuffer as the bytecode VM so only the dispatch differs.
+#pragma once
+#include "../../global.h"
+#include <deque>
+#include <functional>
+
+namespace baseline
+{
+
+class Instruction
+{
+public:
+    virtual void execute(Register &reg) = 0;
+    virtual ~Instruction() = default;
+    virtual const char *name() = 0;
+};
+
+class ConsolePrintlnInstruction : public Instruction
+{
+private:
+    String message;
+
+public:
+    ConsolePrintlnInstruction(const String &msg) : message(msg) {}
+    void execute(Register &reg) override { LOG_INFO("%s", message.c_str()); } // console output goes through the same logger
+    static constexpr const char *NAME = "console_println";
+    const char *name() override { return NAME; }
+};
+
+class DisplayPrintlnInstruction : public Instruction
+{
+private:
+    String message;
+
+public:
+    DisplayPrintlnInstruction(const String &msg) : message(msg) {}
+    void execute(Register &reg) override { display.println(message); }
+    static constexpr const char *NAME = "display_println";
+    const char *name() override { return NAME; }
+};
+
+class DisplayTextColorInstruction : public Instruction
+{
+private:
+    uint16_t color;
+
+public:
+    DisplayTextColorInstruction(const String &colorStr)
+    {
+        if (colorStr.equals("red"))
+        {
+            color = ST77XX_RED;
+        }
+        else if (colorStr.equals("green"))
+        {
+            color = ST77XX_GREEN;
+        }
+        else if (colorStr.equals("blue"))
+        {
+            color = ST77XX_BLUE;
+        }
+        else if (colorStr.equals("black"))
+        {
+            color = ST77XX_BLACK;
+        }
+        else
+        {
+            color = ST77XX_WHITE;
+        }
+    }
+    void execute(Register &reg) override { display.setTextColor(color); }
+    static constexpr const char *NAME = "display_text_color";
+    const char *name() override { return NAME; }
+};
+
+class DisplayTextSizeInstruction : public Instruction
+{
+private:
+    uint8_t size;
+
+public:
+    DisplayTextSizeInstruction(const String &sizeStr) : size(sizeStr.toInt()) {}
+    void execute(Register &reg) override { display.setTextSize(size); }
+    static constexpr const char *NAME = "display_text_size";
+    const char *name() override { return NAME; }
+};
+
+class DisplayCursorInstruction : public Instruction
+{
+private:
+    int16_t x = -1, y = -1;
+
+public:
+    DisplayCursorInstruction(const String &coords)
+    {
+        int colonIndex = coords.indexOf(',');
+        if (colonIndex != -1)
+        {
+            if (coords.substring(0, colonIndex).toInt() > 0)
+            {
+                x = coords.substring(0, colonIndex).toInt();
+            }
+            if (coords.substring(colonIndex + 1).toInt() > 0)
+            {
+                y = coords.substring(colonIndex + 1).toInt();
+            }
+        }
+    }
+    void execute(Register &reg) override
+    {
+        if (x > 0)
+        {
+            display.setCursor(x, display.getCursorY());
+        }
+        if (y > 0)
+        {
+            display.setCursor(display.getCursorX(), y);
+        }
+    }
+    static constexpr const char *NAME = "display_cursor";
+    const char *name() override { return NAME; }
+};
+
+class WriteRegisterInstruction : public Instruction
+{
+private:
+    String value;
+
+public:
+    WriteRegisterInstruction(const String &val) : value(val) {}
+    void execute(Register &reg) override { reg.set(value); }
+    static constexpr const char *NAME = "write_register";
+    const char *name() override { return NAME; }
+};
+
+// The other instructions of the old chain, only their names are compared before falling through
+static const char *const OTHER_NAMES[] = {"display_brightness", "display_text_hexcolor", "display_fill_screen", "delay"};
+
+Instruction *instructionFromString(const String &instructionStr)
+{
+    if (instructionStr.indexOf(':') == -1)
+    {
+        return nullptr;
+    }
+
+    String commandStr = instructionStr.substring(0, instructionStr.indexOf(':'));
+    commandStr.trim();
+    const char *command = commandStr.c_str();
+
+    String value = instructionStr.substring(instructionStr.indexOf(':') + 1);
+    value.trim();
+    Serial.printf("Parsed command: %s, value: %s\n", command, value.c_str());
+
+    if (strcmp(command, ConsolePrintlnInstruction::NAME) == 0)
+    {
+        return new ConsolePrintlnInstruction(value);
+    }
+    else if (strcmp(command, DisplayPrintlnInstruction::NAME) == 0)
+    {
+        return new DisplayPrintlnInstruction(value);
+    }
+    // Same position as in the old chain: brightness and hexcolor were compared before text color
+    else if (strcmp(command, OTHER_NAMES[0]) == 0 || strcmp(command, OTHER_NAMES[1]) == 0)
+    {
+        return nullptr;
+    }
+    else if (strcmp(command, DisplayTextColorInstruction::NAME) == 0)
+    {
+        return new DisplayTextColorInstruction(value);
+    }
+    else if (strcmp(command, DisplayTextSizeInstruction::NAME) == 0)
+    {
+        return new DisplayTextSizeInstruction(value);
+    }
+    else if (strcmp(command, OTHER_NAMES[2]) == 0)
+    {
+        return nullptr;
+    }
+    else if (strcmp(command, DisplayCursorInstruction::NAME) == 0)
+    {
+        return new DisplayCursorInstruction(value);
+    }
+    else if (strcmp(command, OTHER_NAMES[3]) == 0)
+    {
+        return nullptr;
+    }
+    else if (strcmp(command, WriteRegisterInstruction::NAME) == 0)
+    {
+        return new WriteRegisterInstruction(value);
+    }
+    return nullptr;
+}
+
+void string_split(const String &str, char delimiter, std::function<void(const String &)> callback)
+{
+    int start = 0;
+    int end = str.indexOf(delimiter);
+    while (end != -1)
+    {
+        callback(str.substring(start, end));
+        start = end + 1;
+        end = str.indexOf(delimiter, start);
+    }
+    callback(str.substring(start));
+}
+
+// The old /command handler and VM::run(): every line becomes a queued object, run() pops and executes them
+class ObjectVM
+{
+public:
+    Register reg;
+    std::deque<std::unique_ptr<Instruction>> instructions;
+
+    void compile(const String &command)
+    {
+        string_split(command, '\n',
+                     [this](const String &line)
+                     {
+                         if (!line.isEmpty())
+                         {
+                             Instruction *instruction = instructionFromString(line);
+                             if (instruction)
+                             {
+                                 instructions.push_back(std::unique_ptr<Instruction>(instruction));
+                             }
+                         }
+                     });
+    }
+
+    void run()
+    {
+        while (!instructions.empty())
+        {
+            std::unique_ptr<Instruction> instruction = std::move(instructions.front());
+            instructions.pop_front();
+            Serial.printf("Executing instruction: %s\n", instruction->name());
+            instruction->execute(reg);
+        }
+    }
+};
+
+} // namespace baseline
@@ -0,0 +1,66 @@
+// display_picture() with simulated flash and SPI latencies: the blit task should hide the SPI time behind the reads
+#include "../global.h"
+#include "host.h"
+
+#define FLASH_NS_PER_BYTE 300 // about 3.3 MB/s out of LittleFS
+#define SPI_NS_PER_BYTE 200   // 40 MHz SPI clock
+#define FRAMES 5
+
+struct Run
+{
+  uint32_t totalUs;
+  uint32_t readUs;
+  uint32_t pushUs;
+};
+
+Run drawFrames()
+{
+  Run run = {};
+  for (int i = 0; i < FRAMES; i++)
+  {
+    display_picture("/test.raw");
+    run.totalUs += display_frame_timing.total_us / FRAMES;
+    run.readUs += display_frame_timing.read_us / FRAMES;
+    run.pushUs += display_frame_timing.push_us / FRAMES;
+  }
+  return run;
+}
+
+int main()
+{
+  HOST_CHECK(host_fs_copy("data/test.raw", "/test.raw"));
+  display.begin(); // as at boot, without the heap for a framebuffer it draws directly
+  catalog.begin(SPIFFS);
+  host_latency.flashReadNsPerByte = FLASH_NS_PER_BYTE;
+  host_latency.spiNsPerByte = SPI_NS_PER_BYTE;
+
+  // Without display_blit_begin() every segment is pushed before the next one is read
+  Run serial = drawFrames();
+  display_blit_begin();
+  HOST_CHECK(blit_jobs != nullptr);
+  Run pipelined = drawFrames();
+
+  uint32_t segmentPushUs = TFT_DRAW_SECTION * 2 * SPI_NS_PER_BYTE / 1000;
+  printf("serial:    total=%uus read=%uus push=%uus\n", serial.totalUs, serial.readUs, serial.pushUs);
+  printf("pipelined: total=%uus read=%uus push=%uus\n", pipelined.totalUs, pipelined.readUs, pipelined.pushUs);
+  printf("pipelined/serial: %.2f, read + one segment push: %uus\n", (double)pipelined.totalUs / serial.totalUs, pipelined.readUs + segmentPushUs);
+
+  // Serial pays read + push, pipelined about max(read, push) plus the last segment's push
+  HOST_CHECK(serial.totalUs >= serial.readUs + serial.pushUs);
+  HOST_CHECK(pipelined.totalUs < serial.totalUs * 8 / 10);
+  HOST_CHECK(pipelined.totalUs < (pipelined.readUs + segmentPushUs) * 12 / 10);
+  host_latency = HostLatency();
+
+  // The leading segments come from the cache, the file is gone when the tail is read: only the cached ones are pushed
+  frame_cache.begin();
+  display_picture("/test.raw");
+  display_picture("/test.raw");
+  HOST_CHECK(display_frame_timing.cached_segments > 0 && display_frame_timing.cached_segments < TFT_SEGMENTS);
+  uint32_t cached = display_frame_timing.cached_segments;
+  SPIFFS.remove("/test.raw");
+  host_counters_reset();
+  display_picture("/test.raw");
+  HOST_CHECK(display_frame_timing.cached_segments == cached);
+  HOST_CHECK(host_counters.spiBytes == (uint64_t)cached * TFT_DRAW_SECTION * 2);
+  return host_finish("blit_pipeline");
+}
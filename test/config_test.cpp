@@ -0,0 +1,50 @@
+// Config files as editors, echo and uploads write them: trailing newlines and spaces are accepted, invalid values fall back
+#include "../global.h"
+#include "host.h"
+
+bool writeText(const char *path, const char *text)
+{
+    File file = SPIFFS.open(path, "w");
+    bool written = file && file.print(text) == strlen(text);
+    file.close();
+    return written;
+}
+
+String readText(const char *path)
+{
+    String text;
+    File file = SPIFFS.open(path, "r");
+    while (file && file.available())
+    {
+        text += (char)file.read();
+    }
+    file.close();
+    return text;
+}
+
+int main()
+{
+    HOST_CHECK(writeText("/offset", "5\r\n"));
+    HOST_CHECK(writeText("/background", "/moveit.raw \n"));
+    catalog.begin(SPIFFS);
+    config.begin(SPIFFS);
+    HOST_CHECK(config.getInt("offset") == 5);
+    HOST_CHECK(config.getString("background") == "/moveit.raw");
+
+    // An upload replacing the file, then one that is not a number
+    HOST_CHECK(writeText("/offset", " -3 \n"));
+    config.reload("/offset");
+    HOST_CHECK(config.getInt("offset") == -3);
+    HOST_CHECK(writeText("/offset", "5x\n"));
+    config.reload("/offset");
+    HOST_CHECK(config.getInt("offset") == 2);
+
+    // /update passes the data parameter as sent, the file gets the trimmed value
+    HOST_CHECK(config.set("offset", "7\n"));
+    HOST_CHECK(config.getInt("offset") == 7);
+    HOST_CHECK(readText("/offset") == "7");
+    HOST_CHECK(!config.set("offset", "20"));
+    HOST_CHECK(!config.set("offset", ""));
+    HOST_CHECK(config.getInt("offset") == 7);
+    return host_finish("config");
+}
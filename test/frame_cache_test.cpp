@@ -0,0 +1,45 @@
+// The prefetch task holds the frame cache's lock only to reserve and to publish an entry: an upload's eviction on the
+// AsyncTCP task does not wait for the decode, and an entry evicted mid-decode is freed instead of published
+#include "../global.h"
+#include "host.h"
+
+#include <atomic>
+#include <thread>
+
+#define FLASH_NS_PER_BYTE 3000 // slow enough that the decode is still running when the eviction comes
+
+int main()
+{
+    HOST_CHECK(host_fs_copy("data/test.raw", "/test.raw"));
+    catalog.begin(SPIFFS);
+    display.begin();
+    display_setup();
+    host_latency.flashReadNsPerByte = FLASH_NS_PER_BYTE;
+
+    uint64_t start = host_now_us();
+    HOST_CHECK(display_prefetch("/test.raw"));
+    uint32_t decodeUs = host_now_us() - start;
+    HOST_CHECK(frame_cache.used() > 0);
+    display_frame_cache_evict("/test.raw");
+    HOST_CHECK(frame_cache.used() == 0);
+
+    std::atomic<bool> published(true);
+    std::thread prefetch([&published]()
+                         { published = display_prefetch("/test.raw"); });
+    while (frame_cache.used() == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    start = host_now_us();
+    display_frame_cache_evict("/test.raw");
+    uint32_t evictUs = host_now_us() - start;
+    prefetch.join();
+    printf("decode %uus, an eviction during it returned after %uus\n", decodeUs, evictUs);
+    HOST_CHECK(evictUs < decodeUs / 10);
+    HOST_CHECK(!published && frame_cache.used() == 0);
+
+    // The next prefetch publishes again
+    HOST_CHECK(display_prefetch("/test.raw"));
+    HOST_CHECK(frame_cache.used() > 0);
+    return host_finish("frame_cache");
+}
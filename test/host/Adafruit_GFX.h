@@ -0,0 +1,145 @@
+// Host stand-in for Adafruit GFX: keeps the text state, the classic font is drawn pixel by pixel as the library does,
+// other primitives end in the subclass's fillRect()
+#pragma once
+#include <Arduino.h>
+#include "glcdfont.c"
+
+typedef struct
+{
+  uint16_t bitmapOffset;
+  uint8_t width, height, xAdvance;
+  int8_t xOffset, yOffset;
+} GFXglyph;
+typedef struct
+{
+  uint8_t *bitmap;
+  GFXglyph *glyph;
+  uint16_t first, last;
+  uint8_t yAdvance;
+} GFXfont;
+
+class Adafruit_GFX : public Print
+{
+public:
+  Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), _width(w), _height(h) {}
+
+protected:
+  const int16_t WIDTH, HEIGHT;
+  int16_t _width, _height;
+  int16_t cursor_x = 0, cursor_y = 0;
+  uint16_t textcolor = 0xFFFF, textbgcolor = 0xFFFF;
+  uint8_t textsize_x = 1, textsize_y = 1, rotation = 0;
+  bool wrap = true, _cp437 = false;
+  GFXfont *gfxFont = nullptr;
+
+public:
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+  uint8_t getRotation() const { return rotation; }
+  void setCursor(int16_t x, int16_t y)
+  {
+    cursor_x = x;
+    cursor_y = y;
+  }
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+  void setTextColor(uint16_t c) { textcolor = textbgcolor = c; }
+  void setTextColor(uint16_t c, uint16_t bg)
+  {
+    textcolor = c;
+    textbgcolor = bg;
+  }
+  void setTextSize(uint8_t s) { textsize_x = textsize_y = s ? s : 1; }
+  void setTextSize(uint8_t sx, uint8_t sy)
+  {
+    textsize_x = sx;
+    textsize_y = sy;
+  }
+  void setTextWrap(bool w) { wrap = w; }
+  void getTextBounds(const char *, int16_t, int16_t, int16_t *, int16_t *, uint16_t *, uint16_t *) {}
+  void getTextBounds(const String &, int16_t, int16_t, int16_t *, int16_t *, uint16_t *, uint16_t *) {}
+  void invertDisplay(bool) {}
+
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void startWrite() {}
+  virtual void endWrite() {}
+  virtual void writePixel(int16_t x, int16_t y, uint16_t color) { drawPixel(x, y, color); }
+  virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { fillRect(x, y, w, h, color); }
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {}
+  virtual void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+  virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { fillRect(x, y, w, 1, color); }
+  virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { fillRect(x, y, 1, h, color); }
+  void drawRGBBitmap(int16_t, int16_t, uint16_t *, int16_t, int16_t) {}
+  void drawRGBBitmap(int16_t, int16_t, const uint16_t *, int16_t, int16_t) {}
+  virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { writeFillRect(x, y, 1, h, color); }
+
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size)
+  {
+    drawChar(x, y, c, color, bg, size, size);
+  }
+  // Classic font only, as Adafruit_GFX::drawChar(): one writePixel() or writeFillRect() per glyph pixel
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size_x, uint8_t size_y)
+  {
+    if (x >= _width || y >= _height || x + 6 * size_x - 1 < 0 || y + 8 * size_y - 1 < 0)
+    {
+      return;
+    }
+    if (!_cp437 && c >= 176)
+    {
+      c++;
+    }
+    startWrite();
+    for (int8_t i = 0; i < 5; i++)
+    {
+      uint8_t line = pgm_read_byte(&font[c * 5 + i]);
+      for (int8_t j = 0; j < 8; j++, line >>= 1)
+      {
+        if (line & 1 || bg != color)
+        {
+          uint16_t pixel = line & 1 ? color : bg;
+          if (size_x == 1 && size_y == 1)
+          {
+            writePixel(x + i, y + j, pixel);
+          }
+          else
+          {
+            writeFillRect(x + i * size_x, y + j * size_y, size_x, size_y, pixel);
+          }
+        }
+      }
+    }
+    if (bg != color)
+    {
+      if (size_x == 1 && size_y == 1)
+      {
+        writeFastVLine(x + 5, y, 8, bg);
+      }
+      else
+      {
+        writeFillRect(x + 5 * size_x, y, size_x, 8 * size_y, bg);
+      }
+    }
+    endWrite();
+  }
+
+  using Print::write;
+  size_t write(uint8_t c) override
+  {
+    if (c == '\n')
+    {
+      cursor_x = 0;
+      cursor_y += textsize_y * 8;
+    }
+    else if (c != '\r')
+    {
+      if (wrap && cursor_x + textsize_x * 6 > _width)
+      {
+        cursor_x = 0;
+        cursor_y += textsize_y * 8;
+      }
+      drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+      cursor_x += textsize_x * 6;
+    }
+    return 1;
+  }
+};
@@ -0,0 +1,35 @@
+// Host stand-in for the SPI panel: pixel writes cost host_latency.spiNsPerByte and are counted, so are the address
+// windows every drawing call sets (CASET, RASET and RAMWR, not part of the pixel bytes)
+#pragma once
+#include "Adafruit_GFX.h"
+
+void host_spi_write(size_t bytes);
+void host_spi_pixels(const uint16_t *pixels, uint32_t count, bool bigEndian);
+void host_spi_window();
+
+class Adafruit_SPITFT : public Adafruit_GFX
+{
+public:
+  Adafruit_SPITFT(uint16_t w, uint16_t h) : Adafruit_GFX(w, h) {}
+  void drawPixel(int16_t, int16_t, uint16_t) override
+  {
+    host_spi_window();
+    host_spi_write(2);
+  }
+  // GFX draws a bitmap pixel by pixel, modelled as one transfer of the same bytes
+  void drawRGBBitmap(int16_t, int16_t, const uint16_t *pixels, int16_t w, int16_t h)
+  {
+    host_spi_window();
+    host_spi_pixels(pixels, w > 0 && h > 0 ? (uint32_t)w * h : 0, false);
+  }
+  void drawRGBBitmap(int16_t x, int16_t y, uint16_t *pixels, int16_t w, int16_t h) { drawRGBBitmap(x, y, (const uint16_t *)pixels, w, h); }
+  void fillRect(int16_t, int16_t, int16_t w, int16_t h, uint16_t) override
+  {
+    host_spi_window();
+    host_spi_write(w > 0 && h > 0 ? (size_t)w * h * 2 : 0);
+  }
+  void setAddrWindow(uint16_t, uint16_t, uint16_t, uint16_t) { host_spi_window(); }
+  void writePixels(uint16_t *pixels, uint32_t count, bool block = true, bool bigEndian = false) { host_spi_pixels(pixels, count, bigEndian); }
+  void writeColor(uint16_t, uint32_t count) { host_spi_write((size_t)count * 2); }
+  void dmaWait() {}
+};
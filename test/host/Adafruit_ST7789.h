@@ -0,0 +1,21 @@
+#pragma once
+#include "Adafruit_SPITFT.h"
+
+#define ST77XX_BLACK 0x0000
+#define ST77XX_WHITE 0xFFFF
+#define ST77XX_RED 0xF800
+#define ST77XX_GREEN 0x07E0
+#define ST77XX_BLUE 0x001F
+#define ST77XX_CYAN 0x07FF
+#define ST77XX_MAGENTA 0xF81F
+#define ST77XX_YELLOW 0xFFE0
+#define ST77XX_ORANGE 0xFC00
+
+// Rotation 3 of the 170x320 panel, as display_setup() uses it
+class Adafruit_ST7789 : public Adafruit_SPITFT
+{
+public:
+  Adafruit_ST7789(int8_t cs, int8_t dc, int8_t rst) : Adafruit_SPITFT(320, 170) {}
+  void init(uint16_t width, uint16_t height, uint8_t mode = 0) {}
+  void setRotation(uint8_t r) { rotation = r; }
+};
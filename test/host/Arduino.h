@@ -0,0 +1,261 @@
+// Host stand-in for the parts of the Arduino ESP32 core the sketch uses, see host.h for the test hooks
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <cctype>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define F(x) x
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define OUTPUT 1
+#define INPUT 0
+#define HEX 16
+#define DEC 10
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class String
+{
+public:
+  std::string s;
+
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &c) : s(c) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(long long v) : s(std::to_string(v)) {}
+  String(unsigned long long v) : s(std::to_string(v)) {}
+  String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+  String(double v, unsigned int decimals = 2)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, v);
+    s = buffer;
+  }
+
+  unsigned int length() const { return s.size(); }
+  const char *c_str() const { return s.c_str(); }
+  char *begin() { return &s[0]; }
+  char *end() { return &s[0] + s.size(); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned n)
+  {
+    s.reserve(n);
+    return true;
+  }
+
+  int indexOf(char c, unsigned from = 0) const { return position(s.find(c, from)); }
+  int indexOf(const String &c, unsigned from = 0) const { return position(s.find(c.s, from)); }
+  int lastIndexOf(char c) const { return position(s.rfind(c)); }
+  String substring(unsigned from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(unsigned from, unsigned to) const { return from < to && from < s.size() ? String(s.substr(from, to - from)) : String(); }
+  bool startsWith(const String &o) const { return s.rfind(o.s, 0) == 0; }
+  bool endsWith(const String &o) const { return s.size() >= o.s.size() && s.compare(s.size() - o.s.size(), o.s.size(), o.s) == 0; }
+  bool equals(const String &o) const { return s == o.s; }
+  bool equals(const char *o) const { return s == o; }
+  char operator[](unsigned i) const { return s[i]; }
+  char charAt(unsigned i) const { return s[i]; }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void toCharArray(char *buffer, unsigned n) const
+  {
+    strncpy(buffer, s.c_str(), n);
+    if (n)
+    {
+      buffer[n - 1] = '\0';
+    }
+  }
+
+  void trim()
+  {
+    size_t first = 0;
+    while (first < s.size() && isspace((unsigned char)s[first]))
+    {
+      first++;
+    }
+    size_t last = s.size();
+    while (last > first && isspace((unsigned char)s[last - 1]))
+    {
+      last--;
+    }
+    s = s.substr(first, last - first);
+  }
+  void replace(const String &find, const String &with)
+  {
+    if (find.s.empty())
+    {
+      return;
+    }
+    for (size_t at = s.find(find.s); at != std::string::npos; at = s.find(find.s, at + with.s.size()))
+    {
+      s.replace(at, find.s.size(), with.s);
+    }
+  }
+  void remove(unsigned i) { s.erase(std::min<size_t>(i, s.size())); }
+  void remove(unsigned i, unsigned n) { s.erase(std::min<size_t>(i, s.size()), n); }
+
+  String &operator+=(const String &o) { return append(o.s); }
+  String &operator+=(const char *o) { return append(o); }
+  String &operator+=(char o) { return append(std::string(1, o)); }
+  String &operator+=(int o) { return append(std::to_string(o)); }
+  String &operator+=(unsigned o) { return append(std::to_string(o)); }
+  String &operator+=(long o) { return append(std::to_string(o)); }
+  String &operator+=(unsigned long o) { return append(std::to_string(o)); }
+  String &operator+=(long long o) { return append(std::to_string(o)); }
+  String &operator+=(unsigned long long o) { return append(std::to_string(o)); }
+  bool concat(const char *o, unsigned n)
+  {
+    s.append(o, n);
+    return true;
+  }
+  bool concat(const String &o)
+  {
+    append(o.s);
+    return true;
+  }
+  bool concat(const char *o)
+  {
+    append(o);
+    return true;
+  }
+  bool concat(char o)
+  {
+    append(std::string(1, o));
+    return true;
+  }
+  bool concat(int o)
+  {
+    append(std::to_string(o));
+    return true;
+  }
+  bool concat(unsigned o)
+  {
+    append(std::to_string(o));
+    return true;
+  }
+  bool concat(long o)
+  {
+    append(std::to_string(o));
+    return true;
+  }
+  bool concat(unsigned long o)
+  {
+    append(std::to_string(o));
+    return true;
+  }
+
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const { return s == o; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *o) const { return s != o; }
+  bool operator<(const String &o) const { return s < o.s; }
+
+private:
+  static int position(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+  String &append(const std::string &o)
+  {
+    s += o;
+    return *this;
+  }
+};
+inline String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+inline String operator+(const String &a, const char *b) { return String(a.s + b); }
+inline String operator+(const char *a, const String &b) { return String(a + b.s); }
+extern const String emptyString;
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) { return 1; }
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      write(buffer[i]);
+    }
+    return size;
+  }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return write((const uint8_t *)buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+  }
+  size_t print(const char *str) { return write(str); }
+  size_t print(const String &str) { return write(str.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  template <typename T>
+  size_t print(T value) { return print(String(value)); }
+  template <typename T>
+  size_t print(T value, int) { return print(String(value)); }
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(T value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(T value, int base) { return print(value, base) + println(); }
+  virtual void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+// Quiet unless HOST_VERBOSE is set, then it goes to stderr
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long) {}
+  operator bool() const { return true; }
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+};
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void analogWrite(uint8_t pin, int value);
+int analogRead(uint8_t pin);
+long random(long max);
+long random(long min, long max);
+
+using std::max;
+using std::min;
+template <class T>
+T constrain(T x, T a, T b) { return x < a ? a : (x > b ? b : x); }
+
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
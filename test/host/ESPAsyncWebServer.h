@@ -0,0 +1,298 @@
+// Host stand-in for ESPAsyncWebServer: routes and socket events are kept so tests can call them
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LittleFS.h"
+
+typedef enum
+{
+  HTTP_GET = 0x01,
+  HTTP_POST = 0x02,
+  HTTP_DELETE = 0x04,
+  HTTP_PUT = 0x08,
+  HTTP_ANY = 0x7F,
+} WebRequestMethod;
+typedef int WebRequestMethodComposite;
+
+class AsyncWebParameter
+{
+public:
+  String paramName;
+  String paramValue;
+  const String &name() const { return paramName; }
+  const String &value() const { return paramValue; }
+};
+
+class AsyncWebServerResponse
+{
+public:
+  int code = 0;
+  String contentType;
+  String body;
+  virtual ~AsyncWebServerResponse() {}
+  void addHeader(const String &, const String &) {}
+  void setContentLength(size_t) {}
+  void setContentType(const String &type) { contentType = type; }
+  void setCode(int c) { code = c; }
+};
+
+typedef std::function<String(const String &)> AwsTemplateProcessor;
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+
+// Chunked responses are drained right away into body, with chunks of at most `chunk` bytes
+class AsyncChunkedResponse : public AsyncWebServerResponse
+{
+public:
+  AsyncChunkedResponse(const String &type, AwsResponseFiller filler, size_t chunk = 1436)
+  {
+    contentType = type;
+    std::vector<uint8_t> buffer(chunk);
+    for (size_t index = 0;;)
+    {
+      size_t n = filler(buffer.data(), buffer.size(), index);
+      if (n == 0)
+      {
+        break;
+      }
+      body.concat((const char *)buffer.data(), n);
+      index += n;
+    }
+  }
+};
+
+class AsyncWebServerRequest;
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebServerRequest
+{
+public:
+  File _tempFile;
+  void *_tempObject = nullptr;
+  String requestUrl;
+  std::vector<AsyncWebParameter> params;
+  std::unique_ptr<AsyncWebServerResponse> response;
+  ArDisconnectHandler disconnect;
+
+  ~AsyncWebServerRequest()
+  {
+    if (disconnect)
+    {
+      disconnect();
+    }
+  }
+
+  void addParam(const String &name, const String &value) { params.push_back({name, value}); }
+  bool hasParam(const String &name, bool post = false, bool file = false) const { return getParam(name) != nullptr; }
+  const AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const
+  {
+    for (const AsyncWebParameter &param : params)
+    {
+      if (param.paramName == name)
+      {
+        return &param;
+      }
+    }
+    return nullptr;
+  }
+  const String &url() const { return requestUrl; }
+  size_t contentLength() const { return 0; }
+  void onDisconnect(ArDisconnectHandler handler) { disconnect = handler; }
+
+  AsyncWebServerResponse *beginResponse(int code, const String &type = String(), const String &content = String())
+  {
+    AsyncWebServerResponse *r = new AsyncWebServerResponse();
+    r->code = code;
+    r->contentType = type;
+    r->body = content;
+    return r;
+  }
+  AsyncWebServerResponse *beginResponse(int code, const String &type, const uint8_t *content, size_t length, AwsTemplateProcessor = nullptr)
+  {
+    AsyncWebServerResponse *r = beginResponse(code, type);
+    r->body.concat((const char *)content, length);
+    return r;
+  }
+  AsyncWebServerResponse *beginChunkedResponse(const String &type, AwsResponseFiller filler, AwsTemplateProcessor = nullptr)
+  {
+    return new AsyncChunkedResponse(type, filler);
+  }
+  void send(AsyncWebServerResponse *r)
+  {
+    if (r->code == 0)
+    {
+      r->code = 200;
+    }
+    response.reset(r);
+  }
+  void send(int code, const String &type = String(), const String &content = String()) { send(beginResponse(code, type, content)); }
+  void send(int code, const String &type, const uint8_t *content, size_t length, AwsTemplateProcessor = nullptr) { send(beginResponse(code, type, content, length)); }
+  AsyncWebServerResponse *getResponse() const { return response.get(); }
+  void send_P(int code, const String &type, const uint8_t *content, size_t length, AwsTemplateProcessor = nullptr) { send(beginResponse(code, type, content, length)); }
+  void send(fs::FS &, const String &, const String & = String(), bool = false, AwsTemplateProcessor = nullptr) { send(200); }
+};
+
+class AsyncWebHandler
+{
+public:
+  virtual ~AsyncWebHandler() {}
+};
+class AsyncStaticWebHandler : public AsyncWebHandler
+{
+public:
+  AsyncStaticWebHandler &setDefaultFile(const char *) { return *this; }
+};
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+};
+class AsyncWebRewrite
+{
+};
+
+struct AsyncWebRoute
+{
+  String path;
+  WebRequestMethodComposite method;
+  ArRequestHandlerFunction request;
+  ArUploadHandlerFunction upload;
+  ArBodyHandlerFunction body;
+};
+
+class AsyncWebServer
+{
+public:
+  std::vector<AsyncWebRoute> routes;
+
+  AsyncWebServer(uint16_t) {}
+  void begin() {}
+  AsyncStaticWebHandler &serveStatic(const char *, fs::FS &, const char *, const char * = nullptr)
+  {
+    static AsyncStaticWebHandler handler;
+    return handler;
+  }
+  AsyncCallbackWebHandler &on(const char *path, WebRequestMethodComposite method, ArRequestHandlerFunction request,
+                              ArUploadHandlerFunction upload = nullptr, ArBodyHandlerFunction body = nullptr)
+  {
+    static AsyncCallbackWebHandler handler;
+    routes.push_back({path, method, request, upload, body});
+    return handler;
+  }
+  AsyncWebRewrite &rewrite(const char *, const char *)
+  {
+    static AsyncWebRewrite rewrite;
+    return rewrite;
+  }
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler) { return *handler; }
+  void onNotFound(ArRequestHandlerFunction) {}
+
+  const AsyncWebRoute *route(const char *path) const
+  {
+    for (const AsyncWebRoute &r : routes)
+    {
+      if (r.path == path)
+      {
+        return &r;
+      }
+    }
+    return nullptr;
+  }
+};
+
+typedef enum
+{
+  WS_EVT_CONNECT,
+  WS_EVT_DISCONNECT,
+  WS_EVT_PONG,
+  WS_EVT_ERROR,
+  WS_EVT_DATA,
+} AwsEventType;
+#define WS_CONTINUATION 0x00
+#define WS_TEXT 0x01
+#define WS_BINARY 0x02
+
+typedef struct
+{
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+class AsyncWebSocketClient
+{
+public:
+  uint32_t clientId;
+  uint16_t keepAlive = 0;
+  std::vector<std::string> sent;
+  std::thread::id sender; // of the last message
+
+  AsyncWebSocketClient(uint32_t id = 1) : clientId(id) {}
+  uint32_t id() const { return clientId; }
+  void text(const char *message)
+  {
+    sent.push_back(message);
+    sender = std::this_thread::get_id();
+  }
+  void text(const String &message) { text(message.s.c_str()); }
+  void keepAlivePeriod(uint16_t seconds) { keepAlive = seconds; }
+  bool canSend() const { return true; }
+  void close(uint16_t code = 0, const char *message = nullptr) {}
+};
+
+class AsyncWebSocket;
+typedef std::function<void(AsyncWebSocket *, AsyncWebSocketClient *, AwsEventType, void *, uint8_t *, size_t)> AwsEventHandler;
+
+// Clients are registered by the test, text() and textAll() record into them
+class AsyncWebSocket : public AsyncWebHandler
+{
+public:
+  AwsEventHandler handler;
+  std::map<uint32_t, AsyncWebSocketClient *> clients;
+
+  AsyncWebSocket(const String &) {}
+  void onEvent(AwsEventHandler h) { handler = h; }
+  void cleanupClients(uint16_t max = 8) {}
+  size_t count() const { return clients.size(); }
+  bool availableForWriteAll() { return true; }
+  bool availableForWrite(uint32_t id) { return clients.count(id) > 0; }
+  void text(uint32_t id, const char *message)
+  {
+    if (clients.count(id))
+    {
+      clients[id]->text(message);
+    }
+  }
+  void textAll(const char *message)
+  {
+    for (auto &client : clients)
+    {
+      client.second->text(message);
+    }
+  }
+
+  void event(AsyncWebSocketClient *client, AwsEventType type, void *arg = nullptr, uint8_t *data = nullptr, size_t len = 0)
+  {
+    if (type == WS_EVT_CONNECT)
+    {
+      clients[client->id()] = client;
+    }
+    if (handler)
+    {
+      handler(this, client, type, arg, data, len);
+    }
+    if (type == WS_EVT_DISCONNECT)
+    {
+      clients.erase(client->id());
+    }
+  }
+};
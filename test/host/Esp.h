@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+class EspClass
+{
+public:
+  void restart() {}
+  uint32_t getFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getHeapSize() { return 320 * 1024; }
+  uint32_t getFreePsram();
+  uint32_t getPsramSize();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getCycleCount();
+};
+extern EspClass ESP;
+
+bool psramFound();
+inline void *ps_malloc(size_t size) { return malloc(size); }
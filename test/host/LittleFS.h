@@ -0,0 +1,200 @@
+// Host stand-in for LittleFS, files live below host_fs_root() and access costs host_latency
+#pragma once
+#include <Arduino.h>
+#include <cstdio>
+#include <dirent.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+const char *host_fs_root();
+void host_flash_open();
+void host_flash_read(size_t bytes);
+void host_flash_write(size_t bytes);
+
+namespace fs
+{
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+inline std::string hostPath(const std::string &path)
+{
+  return host_fs_root() + path;
+}
+
+class File : public Stream
+{
+private:
+  std::shared_ptr<FILE> file;
+  std::shared_ptr<DIR> dir;
+  std::string filePath;
+
+public:
+  File() {}
+  File(const std::string &path, const char *mode) : filePath(path)
+  {
+    std::string host = hostPath(path);
+    struct stat st;
+    if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      dir.reset(opendir(host.c_str()), [](DIR *d)
+                { if (d) closedir(d); });
+      return;
+    }
+    const char *hostMode = mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb";
+    host_flash_open();
+    FILE *handle = fopen(host.c_str(), hostMode);
+    if (handle)
+    {
+      file.reset(handle, [](FILE *f)
+                 { fclose(f); });
+    }
+  }
+
+  operator bool() const { return file || dir; }
+  bool isDirectory() const { return dir != nullptr; }
+  const char *name() const { return filePath.c_str() + filePath.rfind('/') + 1; }
+  const char *path() const { return filePath.c_str(); }
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    if (!file)
+    {
+      return 0;
+    }
+    host_flash_write(size);
+    return fwrite(buffer, 1, size, file.get());
+  }
+  size_t read(uint8_t *buffer, size_t size)
+  {
+    if (!file)
+    {
+      return 0;
+    }
+    size_t n = fread(buffer, 1, size, file.get());
+    host_flash_read(n);
+    return n;
+  }
+  int read() override
+  {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  size_t readBytes(char *buffer, size_t size) { return read((uint8_t *)buffer, size); }
+  size_t readBytes(uint8_t *buffer, size_t size) { return read(buffer, size); }
+  String readStringUntil(char terminator)
+  {
+    String line;
+    int c;
+    while ((c = read()) >= 0 && c != terminator)
+    {
+      line += (char)c;
+    }
+    return line;
+  }
+  String readString()
+  {
+    String text;
+    int c;
+    while ((c = read()) >= 0)
+    {
+      text += (char)c;
+    }
+    return text;
+  }
+  int available() override
+  {
+    return file ? (int)(size() - position()) : 0;
+  }
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) { return file && fseek(file.get(), pos, mode) == 0; }
+  size_t position() const { return file ? ftell(file.get()) : 0; }
+  size_t size() const
+  {
+    if (file)
+    {
+      fflush(file.get());
+    }
+    struct stat st;
+    return stat(hostPath(filePath).c_str(), &st) == 0 ? st.st_size : 0;
+  }
+  time_t getLastWrite()
+  {
+    struct stat st;
+    return stat(hostPath(filePath).c_str(), &st) == 0 ? st.st_mtime : 0;
+  }
+  void flush() override
+  {
+    if (file)
+    {
+      fflush(file.get());
+    }
+  }
+  bool setBufferSize(size_t) { return true; }
+  void close()
+  {
+    file.reset();
+    dir.reset();
+  }
+
+  File openNextFile(const char *mode = FILE_READ)
+  {
+    while (dir)
+    {
+      struct dirent *entry = readdir(dir.get());
+      if (!entry)
+      {
+        break;
+      }
+      std::string name = entry->d_name;
+      if (name != "." && name != "..")
+      {
+        return File((filePath == "/" ? "/" : filePath + "/") + name, mode);
+      }
+    }
+    return File();
+  }
+};
+
+class FS
+{
+public:
+  File open(const char *path, const char *mode = FILE_READ, bool create = false) { return File(path, mode); }
+  File open(const String &path, const char *mode = FILE_READ, bool create = false) { return File(path.c_str(), mode); }
+  bool exists(const char *path)
+  {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+  }
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path) { return ::remove(hostPath(path).c_str()) == 0; }
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to) { return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0; }
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+  bool rmdir(const String &path) { return rmdir(path.c_str()); }
+};
+
+class LittleFSFS : public FS
+{
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *label = nullptr) { return true; }
+  size_t totalBytes() { return 1408 * 1024; }
+  size_t usedBytes() { return 0; }
+};
+} // namespace fs
+
+using fs::File;
+extern fs::LittleFSFS LittleFS;
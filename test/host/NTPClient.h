@@ -0,0 +1,18 @@
+#pragma once
+#include <Arduino.h>
+#include "WiFiUdp.h"
+
+class NTPClient
+{
+public:
+  NTPClient(WiFiUDP &) {}
+  NTPClient(WiFiUDP &, const char *, long offset = 0, unsigned long interval = 60000) {}
+  void begin() {}
+  bool update() { return true; }
+  bool forceUpdate() { return true; }
+  bool isTimeSet() const { return true; }
+  void setTimeOffset(int) {}
+  void setUpdateInterval(unsigned long) {}
+  unsigned long getEpochTime() const { return 0; }
+  String getFormattedTime() const { return "00:00:00"; }
+};
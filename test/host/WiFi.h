@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+typedef int wl_status_t;
+
+class IPAddress
+{
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {}
+  String toString() const { return "127.0.0.1"; }
+};
+
+class WiFiClass
+{
+public:
+  wl_status_t state = WL_DISCONNECTED;
+  bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress(), IPAddress = IPAddress()) { return true; }
+  bool setHostname(const char *) { return true; }
+  wl_status_t begin(const char *, const char *) { return state; }
+  wl_status_t status() { return state; }
+  IPAddress localIP() { return IPAddress(); }
+};
+extern WiFiClass WiFi;
+
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
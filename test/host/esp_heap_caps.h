@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#define MALLOC_CAP_SPIRAM 0x01
+#define MALLOC_CAP_8BIT 0x02
+#define MALLOC_CAP_INTERNAL 0x04
+#define MALLOC_CAP_DEFAULT 0x08
+#define MALLOC_CAP_DMA 0x10
+
+// Sizes come from host_heap (host.h), allocations from malloc()
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_total_size(uint32_t caps);
@@ -0,0 +1,5 @@
+// The panel is not rendered on the host, the glyph bitmaps only need the right size
+#ifndef FONT5X7_H
+#define FONT5X7_H
+static const unsigned char font[256 * 5] = {0};
+#endif
@@ -0,0 +1,631 @@
+// Arduino, FreeRTOS and ESP-IDF stand-ins for the host tests: tasks are threads, flash is a temporary directory
+#include <Arduino.h>
+#include <Esp.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <esp_cpu.h>
+#include "host.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <ftw.h>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+const String emptyString;
+fs::LittleFSFS LittleFS;
+EspClass ESP;
+WiFiClass WiFi;
+
+HostLatency host_latency;
+HostCounters host_counters;
+HostHeap host_heap;
+int host_failures = 0;
+
+void host_counters_reset()
+{
+  host_counters.flashOpens = 0;
+  host_counters.flashReads = 0;
+  host_counters.flashReadBytes = 0;
+  host_counters.flashWrites = 0;
+  host_counters.flashWriteBytes = 0;
+  host_counters.flashModelledUs = 0;
+  host_counters.spiBytes = 0;
+  host_counters.spiWindows = 0;
+  host_counters.spiModelledUs = 0;
+  host_counters.spiPixelHash = 2166136261u;
+  host_counters.allocations = 0;
+}
+
+// Counted allocations, benchmarks compare host_counters.allocations before and after a call
+void *operator new(size_t size)
+{
+  host_counters.allocations.fetch_add(1, std::memory_order_relaxed);
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  static const bool verbose = getenv("HOST_VERBOSE") != nullptr;
+  if (verbose)
+  {
+    fwrite(buffer, 1, size, stderr);
+  }
+  return size;
+}
+
+// Clock
+
+static const auto host_start = std::chrono::steady_clock::now();
+static std::atomic<bool> fake_clock(false);
+static std::atomic<uint64_t> fake_us(0);
+
+uint64_t host_now_us()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - host_start).count();
+}
+
+static uint64_t clock_us()
+{
+  return fake_clock ? fake_us.load() : host_now_us();
+}
+
+void host_clock_fake(bool enabled)
+{
+  fake_us = host_now_us();
+  fake_clock = enabled;
+}
+void host_clock_advance_us(uint64_t us) { fake_us += us; }
+void host_clock_advance_ms(uint32_t ms) { fake_us += (uint64_t)ms * 1000; }
+
+unsigned long millis() { return clock_us() / 1000; }
+unsigned long micros() { return (unsigned long)clock_us(); }
+int64_t esp_timer_get_time() { return clock_us(); }
+uint32_t esp_cpu_get_cycle_count() { return (uint32_t)(clock_us() * 240); }
+uint32_t EspClass::getCycleCount() { return esp_cpu_get_cycle_count(); }
+
+static void sleep_us(uint64_t us)
+{
+  if (us > 0)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+}
+
+struct esp_timer
+{
+  esp_timer_create_args_t args;
+  uint32_t generation = 0; // started or stopped since a sleeping thread was started for it
+  bool armed = false;
+};
+
+namespace
+{
+std::mutex timer_mutex;
+std::condition_variable timer_cv;
+uint32_t timers_busy = 0; // armed or running
+std::mutex timer_task;    // one callback at a time
+} // namespace
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+  *handle = new esp_timer{*args};
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+  std::lock_guard<std::mutex> lock(timer_mutex);
+  if (timer->armed)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  uint32_t generation = ++timer->generation;
+  timers_busy++;
+  std::thread([timer, timeout_us, generation]()
+              {
+    sleep_us(timeout_us);
+    std::lock_guard<std::mutex> task(timer_task);
+    bool fire;
+    {
+      std::lock_guard<std::mutex> lock(timer_mutex);
+      fire = timer->armed && timer->generation == generation;
+      timer->armed = fire ? false : timer->armed;
+    }
+    if (fire)
+    {
+      timer->args.callback(timer->args.arg);
+    }
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    timers_busy--;
+    timer_cv.notify_all(); })
+      .detach();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  std::lock_guard<std::mutex> lock(timer_mutex);
+  if (!timer->armed)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  timer->generation++;
+  return ESP_OK;
+}
+
+void host_timers_wait()
+{
+  std::unique_lock<std::mutex> lock(timer_mutex);
+  timer_cv.wait(lock, []()
+                { return timers_busy == 0; });
+}
+
+void delay(unsigned long ms)
+{
+  if (fake_clock)
+  {
+    host_clock_advance_ms(ms);
+    return;
+  }
+  sleep_us((uint64_t)ms * 1000);
+}
+void delayMicroseconds(unsigned us) { sleep_us(us); }
+void yield() { std::this_thread::yield(); }
+void pinMode(uint8_t, uint8_t) {}
+void analogWrite(uint8_t, int) {}
+int analogRead(uint8_t) { return 0; }
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+
+// Flash and SPI latency model
+
+void host_flash_open()
+{
+  host_counters.flashOpens++;
+  host_counters.flashModelledUs += host_latency.flashOpenUs;
+  sleep_us(host_latency.flashOpenUs);
+}
+
+void host_flash_read(size_t bytes)
+{
+  uint64_t us = (uint64_t)bytes * host_latency.flashReadNsPerByte / 1000;
+  host_counters.flashReads++;
+  host_counters.flashReadBytes += bytes;
+  host_counters.flashModelledUs += us;
+  sleep_us(us);
+}
+
+void host_flash_write(size_t bytes)
+{
+  uint64_t us = host_latency.flashWriteCallUs + (uint64_t)bytes * host_latency.flashWriteNsPerByte / 1000;
+  host_counters.flashWrites++;
+  host_counters.flashWriteBytes += bytes;
+  host_counters.flashModelledUs += us;
+  sleep_us(us);
+}
+
+void host_spi_write(size_t bytes)
+{
+  uint64_t us = (uint64_t)bytes * host_latency.spiNsPerByte / 1000;
+  host_counters.spiBytes += bytes;
+  host_counters.spiModelledUs += us;
+  sleep_us(us);
+}
+
+void host_spi_window()
+{
+  host_counters.spiWindows++;
+}
+
+void host_spi_pixels(const uint16_t *pixels, uint32_t count, bool bigEndian)
+{
+  uint32_t hash = host_counters.spiPixelHash;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint16_t pixel = bigEndian ? pixels[i] : __builtin_bswap16(pixels[i]);
+    hash = (hash ^ (pixel & 0xFF)) * 16777619u;
+    hash = (hash ^ (pixel >> 8)) * 16777619u;
+  }
+  host_counters.spiPixelHash = hash;
+  host_spi_write((size_t)count * 2);
+}
+
+// Filesystem root
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+{
+  return ::remove(path);
+}
+
+static std::string &fs_root()
+{
+  static std::string root = []()
+  {
+    char pattern[] = "/tmp/host-fs-XXXXXX";
+    const char *dir = mkdtemp(pattern);
+    return std::string(dir ? dir : "/tmp");
+  }();
+  return root;
+}
+
+const char *host_fs_root() { return fs_root().c_str(); }
+
+bool host_fs_write(const char *fsPath, const void *data, size_t size)
+{
+  FILE *f = fopen((fs_root() + fsPath).c_str(), "wb");
+  if (!f)
+  {
+    return false;
+  }
+  bool ok = fwrite(data, 1, size, f) == size;
+  fclose(f);
+  return ok;
+}
+
+bool host_fs_copy(const char *hostPath, const char *fsPath)
+{
+  FILE *f = fopen(hostPath, "rb");
+  if (!f)
+  {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), f)) > 0;)
+  {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  return host_fs_write(fsPath, data.data(), data.size());
+}
+
+void host_fs_clear()
+{
+  nftw(fs_root().c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  ::mkdir(fs_root().c_str(), 0755);
+}
+
+int host_finish(const char *name)
+{
+  nftw(fs_root().c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  printf("%s: %s\n", name, host_failures ? "FAILED" : "ok");
+  fflush(stdout);
+  fflush(stderr);
+  _exit(host_failures ? 1 : 0);
+}
+
+// Heap
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+  if ((caps & MALLOC_CAP_SPIRAM) ? size > host_heap.psram : size > host_heap.internalFree)
+  {
+    return nullptr;
+  }
+  return malloc(size);
+}
+void heap_caps_free(void *ptr) { free(ptr); }
+size_t heap_caps_get_free_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? host_heap.psram : host_heap.internalFree; }
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return heap_caps_get_free_size(caps); }
+size_t heap_caps_get_minimum_free_size(uint32_t caps) { return heap_caps_get_free_size(caps); }
+size_t heap_caps_get_total_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? host_heap.psram : 320 * 1024; }
+uint32_t EspClass::getFreeHeap() { return host_heap.internalFree; }
+uint32_t EspClass::getMaxAllocHeap() { return host_heap.internalFree; }
+uint32_t EspClass::getMinFreeHeap() { return host_heap.internalFree; }
+uint32_t EspClass::getFreePsram() { return host_heap.psram; }
+uint32_t EspClass::getPsramSize() { return host_heap.psram; }
+bool psramFound() { return host_heap.psram > 0; }
+esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+uint32_t esp_get_free_heap_size() { return host_heap.internalFree; }
+
+// FreeRTOS
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point deadline(TickType_t ticks)
+{
+  return ticks == portMAX_DELAY ? Clock::time_point::max() : Clock::now() + std::chrono::milliseconds(ticks);
+}
+
+template <typename Predicate>
+bool wait_until(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate ready)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_until(lock, deadline(ticks), ready);
+}
+
+#define HOST_TASK_STACK_PAINT 0xa5         // what FreeRTOS fills a new task's stack with
+#define HOST_TASK_STACK_HEADROOM (64 * 1024) // glibc's printf alone can take more than a device task has
+
+struct Task
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifications = 0;
+  // Created tasks run on a painted stack of their own, measured from where the task function starts as FreeRTOS does
+  uint8_t *stack = nullptr;
+  uint8_t *entry = nullptr;
+  uint32_t stackSize = 0; // as asked for, the thread gets headroom for the host's larger frames
+};
+
+thread_local Task *current_task = nullptr;
+
+Task *this_task()
+{
+  if (!current_task)
+  {
+    current_task = new Task(); // lives as long as the thread, tasks never end in the sketch
+  }
+  return current_task;
+}
+
+struct Queue
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  size_t length;
+  size_t itemSize;
+};
+
+struct Semaphore
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t count;
+  uint32_t max;
+  std::thread::id owner; // recursive mutexes only
+  uint32_t depth = 0;
+};
+} // namespace
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+  Task *created = new Task();
+  if (handle)
+  {
+    *handle = created;
+  }
+  created->stackSize = stack;
+  size_t size = stack * 2 + HOST_TASK_STACK_HEADROOM;
+  created->stack = (uint8_t *)malloc(size);
+  memset(created->stack, HOST_TASK_STACK_PAINT, size);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, created->stack, size);
+  struct Start
+  {
+    TaskFunction_t task;
+    void *arg;
+    Task *created;
+  };
+  pthread_t thread;
+  int error = pthread_create(
+      &thread, &attr, [](void *start) -> void *
+      {
+        Start begin = *(Start *)start;
+        delete (Start *)start;
+        uint8_t here;
+        begin.created->entry = &here;
+        current_task = begin.created;
+        begin.task(begin.arg);
+        return nullptr; },
+      new Start{task, arg, created});
+  pthread_attr_destroy(&attr);
+  if (error)
+  {
+    return pdFAIL;
+  }
+  pthread_detach(thread);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  return xTaskCreate(task, name, stack, arg, priority, handle);
+}
+
+// Bytes of the asked for stack never touched since the task started, the stack grows down into the paint
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle)
+{
+  Task *task = handle ? (Task *)handle : this_task();
+  if (!task->stack)
+  {
+    return 0;
+  }
+  uint8_t *deepest = task->stack;
+  while (*deepest == HOST_TASK_STACK_PAINT)
+  {
+    deepest++;
+  }
+  size_t used = task->entry - deepest;
+  return used < task->stackSize ? task->stackSize - used : 0;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t ticks) { sleep_us((uint64_t)ticks * 1000); }
+TickType_t xTaskGetTickCount() { return millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return this_task(); }
+BaseType_t xPortGetCoreID() { return 1; }
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  Task *task = (Task *)handle;
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+  }
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+  Task *task = this_task();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  wait_until(task->cv, lock, ticks, [task]()
+             { return task->notifications > 0; });
+  uint32_t value = task->notifications;
+  if (value > 0)
+  {
+    task->notifications = clear ? 0 : value - 1;
+  }
+  return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  Queue *queue = new Queue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+  Queue *queue = (Queue *)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!wait_until(queue->cv, lock, ticks, [queue]()
+                  { return queue->items.size() < queue->length; }))
+  {
+    return pdFALSE;
+  }
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t handle, const void *item)
+{
+  Queue *queue = (Queue *)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.clear();
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticks)
+{
+  Queue *queue = (Queue *)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!wait_until(queue->cv, lock, ticks, [queue]()
+                  { return !queue->items.empty(); }))
+  {
+    return pdFALSE;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->cv.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+  Queue *queue = (Queue *)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+static Semaphore *semaphore(uint32_t max, uint32_t initial)
+{
+  Semaphore *created = new Semaphore();
+  created->count = initial;
+  created->max = max;
+  return created;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return semaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return semaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return semaphore(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) { return semaphore(max, initial); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+  Semaphore *sem = (Semaphore *)handle;
+  std::unique_lock<std::mutex> lock(sem->mutex);
+  if (!wait_until(sem->cv, lock, ticks, [sem]()
+                  { return sem->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+  Semaphore *sem = (Semaphore *)handle;
+  std::lock_guard<std::mutex> lock(sem->mutex);
+  if (sem->count >= sem->max)
+  {
+    return pdFALSE;
+  }
+  sem->count++;
+  sem->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t handle, TickType_t ticks)
+{
+  Semaphore *sem = (Semaphore *)handle;
+  std::unique_lock<std::mutex> lock(sem->mutex);
+  if (sem->depth > 0 && sem->owner == std::this_thread::get_id())
+  {
+    sem->depth++;
+    return pdTRUE;
+  }
+  if (!wait_until(sem->cv, lock, ticks, [sem]()
+                  { return sem->depth == 0; }))
+  {
+    return pdFALSE;
+  }
+  sem->owner = std::this_thread::get_id();
+  sem->depth = 1;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t handle)
+{
+  Semaphore *sem = (Semaphore *)handle;
+  std::lock_guard<std::mutex> lock(sem->mutex);
+  if (sem->depth == 0 || sem->owner != std::this_thread::get_id())
+  {
+    return pdFALSE;
+  }
+  if (--sem->depth == 0)
+  {
+    sem->cv.notify_all();
+  }
+  return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t handle)
+{
+  Semaphore *sem = (Semaphore *)handle;
+  std::lock_guard<std::mutex> lock(sem->mutex);
+  return sem->count;
+}
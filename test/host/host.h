@@ -0,0 +1,71 @@
+// Hooks for host tests and benchmarks, implemented in host.cpp next to the Arduino and FreeRTOS stand-ins
+#pragma once
+#include <Arduino.h>
+#include <cstdio>
+
+// Latencies added to flash and SPI access, 0 runs at host speed. Reads and writes sleep for the modelled time.
+struct HostLatency
+{
+  uint32_t flashReadNsPerByte = 0;
+  uint32_t flashWriteNsPerByte = 0;
+  uint32_t flashWriteCallUs = 0; // fixed cost of every write() call, e.g. a LittleFS block program
+  uint32_t flashOpenUs = 0;      // fixed cost of opening a file, LittleFS walks the directory's metadata blocks
+  uint32_t spiNsPerByte = 0;
+};
+extern HostLatency host_latency;
+
+struct HostCounters
+{
+  std::atomic<uint64_t> flashOpens{0};
+  std::atomic<uint64_t> flashReads{0};
+  std::atomic<uint64_t> flashReadBytes{0};
+  std::atomic<uint64_t> flashWrites{0};
+  std::atomic<uint64_t> flashWriteBytes{0};
+  std::atomic<uint64_t> flashModelledUs{0}; // time the latencies above added to flash access
+  std::atomic<uint64_t> spiBytes{0};
+  std::atomic<uint64_t> spiWindows{0}; // address windows set, each three commands with their parameters
+  std::atomic<uint64_t> spiModelledUs{0};
+  std::atomic<uint32_t> spiPixelHash{0}; // FNV-1a over every pixel pushed with writePixels(), in panel byte order
+  std::atomic<uint64_t> allocations{0}; // operator new calls
+};
+extern HostCounters host_counters;
+void host_counters_reset();
+
+// Free internal heap reported by heap_caps and ESP, PSRAM is reported as absent while psram is 0
+struct HostHeap
+{
+  size_t internalFree = 200 * 1024;
+  size_t psram = 0;
+};
+extern HostHeap host_heap;
+
+// With a fake clock millis(), micros(), esp_timer and delay() only move when the test advances them
+void host_clock_fake(bool enabled);
+void host_clock_advance_us(uint64_t us);
+void host_clock_advance_ms(uint32_t ms);
+
+// Returns once no esp_timer is armed and no callback is running
+void host_timers_wait();
+
+// Every test process gets its own empty directory for LittleFS, paths are absolute inside it
+const char *host_fs_root();
+bool host_fs_copy(const char *hostPath, const char *fsPath);
+bool host_fs_write(const char *fsPath, const void *data, size_t size);
+void host_fs_clear();
+
+// Wall clock of the host, not affected by the fake clock
+uint64_t host_now_us();
+
+extern int host_failures;
+#define HOST_CHECK(condition)                                                   \
+  do                                                                            \
+  {                                                                             \
+    if (!(condition))                                                           \
+    {                                                                           \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      host_failures++;                                                          \
+    }                                                                           \
+  } while (0)
+
+// Prints the result and leaves without running destructors of globals still used by detached tasks
+int host_finish(const char *name);
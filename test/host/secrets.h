@@ -0,0 +1,8 @@
+#ifndef SECRETS_H
+#define SECRETS_H
+
+const char *hostname = "esp32-host";
+const char *ssid = "";
+const char *password = "";
+
+#endif
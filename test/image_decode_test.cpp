@@ -0,0 +1,97 @@
+// Raw, RLE and palette encodings of the same pictures through display_picture(): bytes read from flash and frame time
+#include "../global.h"
+#include "host.h"
+
+#define FLASH_NS_PER_BYTE 300 // about 3.3 MB/s out of LittleFS
+#define SPI_NS_PER_BYTE 200   // 40 MHz SPI clock
+#define FRAMES 3
+
+struct Run
+{
+  uint32_t fileBytes;
+  uint32_t flashBytes;
+  uint32_t readUs;
+  uint32_t totalUs;
+  uint32_t pixelHash;
+};
+
+// Converts data/<name>.raw with tools/image_convert.py, false if the encoding does not fit the picture
+bool convert(const char *name, const char *encoding, String &path)
+{
+  path = String("/") + name + "." + encoding + ".img";
+  char command[512];
+  snprintf(command, sizeof(command), "python3 tools/image_convert.py data/%s.raw %s%s --encoding %s >/dev/null 2>&1",
+           name, host_fs_root(), path.c_str(), encoding);
+  return system(command) == 0;
+}
+
+Run draw(const String &path)
+{
+  Run run = {};
+  File file = SPIFFS.open(path, "r");
+  run.fileBytes = file ? file.size() : 0;
+  file.close();
+  for (int i = 0; i < FRAMES; i++)
+  {
+    host_counters_reset();
+    display_picture(path);
+    run.flashBytes = display_frame_timing.flash_bytes;
+    run.readUs += display_frame_timing.read_us / FRAMES;
+    run.totalUs += display_frame_timing.total_us / FRAMES;
+    run.pixelHash = host_counters.spiPixelHash;
+  }
+  return run;
+}
+
+void print(const char *name, const char *encoding, const Run &run)
+{
+  printf("%-10s %-8s file=%6u flash=%6u read=%6uus total=%6uus\n", name, encoding, run.fileBytes, run.flashBytes, run.readUs, run.totalUs);
+}
+
+int main()
+{
+  display.begin(); // as at boot, without the heap for a framebuffer it draws directly
+  host_latency.flashReadNsPerByte = FLASH_NS_PER_BYTE;
+  host_latency.spiNsPerByte = SPI_NS_PER_BYTE;
+  display_blit_begin();
+
+  const char *pictures[] = {"test", "moveit", "thisisfine"};
+  for (const char *name : pictures)
+  {
+    // The headerless .raw is the legacy path, every container has to put the same pixels on the panel
+    String legacy = String("/") + name + ".raw";
+    HOST_CHECK(host_fs_copy((String("data") + legacy).c_str(), legacy.c_str()));
+    String paths[3];
+    const char *encodings[] = {"raw", "rle", "palette"};
+    bool converted[3];
+    for (int i = 0; i < 3; i++)
+    {
+      converted[i] = convert(name, encodings[i], paths[i]);
+    }
+    HOST_CHECK(converted[0] && converted[1]);
+    catalog.begin(SPIFFS);
+
+    Run reference = draw(legacy);
+    print(name, "legacy", reference);
+    HOST_CHECK(reference.flashBytes == TFT_WIDTH * TFT_HEIGHT * 2);
+    for (int i = 0; i < 3; i++)
+    {
+      if (!converted[i])
+      {
+        printf("%-10s %-8s more than 256 colors, skipped\n", name, encodings[i]);
+        continue;
+      }
+      Run run = draw(paths[i]);
+      print(name, encodings[i], run);
+      HOST_CHECK(run.pixelHash == reference.pixelHash);
+      HOST_CHECK(run.flashBytes <= run.fileBytes);
+      if (i > 0 && run.fileBytes < reference.fileBytes / 2)
+      {
+        // Compressed pictures read a fraction of the bytes, the frame is then bound by the SPI push
+        HOST_CHECK(run.readUs < reference.readUs / 2);
+        HOST_CHECK(run.totalUs < reference.totalUs);
+      }
+    }
+  }
+  return host_finish("image_decode");
+}
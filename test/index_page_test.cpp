@@ -0,0 +1,86 @@
+// /index.html from the pre-parsed template against the old per-request file read and scan: requests per second and latency
+#include "baseline/file_template.h"
+#include "host.h"
+
+#define FLASH_NS_PER_BYTE 300 // about 3.3 MB/s out of LittleFS
+#define REQUESTS 500
+
+struct Run
+{
+    double rps;
+    uint32_t p50Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+    uint64_t flashBytes;
+    uint64_t allocations;
+    String body;
+};
+
+Run measure(std::function<void(AsyncWebServerRequest *)> handler)
+{
+    std::vector<uint32_t> latencies;
+    Run run;
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        AsyncWebServerRequest request;
+        request.requestUrl = "/index.html";
+        uint64_t begin = host_now_us();
+        handler(&request);
+        latencies.push_back(host_now_us() - begin);
+        HOST_CHECK(request.getResponse() && request.getResponse()->code == 200);
+        if (i == 0)
+        {
+            run.body = request.getResponse()->body;
+        }
+    }
+    uint64_t total = host_now_us() - start;
+    std::sort(latencies.begin(), latencies.end());
+    run.rps = REQUESTS * 1e6 / total;
+    run.p50Us = latencies[REQUESTS / 2];
+    run.p99Us = latencies[REQUESTS * 99 / 100];
+    run.maxUs = latencies.back();
+    run.flashBytes = host_counters.flashReadBytes / REQUESTS;
+    run.allocations = host_counters.allocations / REQUESTS;
+    return run;
+}
+
+void print(const char *name, const Run &run)
+{
+    printf("%-9s %7.0f req/s p50=%5uus p99=%5uus max=%5uus flash=%5llu bytes/req allocations=%3llu/req page=%u bytes\n", name,
+           run.rps, run.p50Us, run.p99Us, run.maxUs, run.flashBytes, run.allocations, run.body.length());
+}
+
+int main()
+{
+    const char *pictures[] = {"test", "moveit", "lunch", "thisisfine", "noneofmy"};
+    for (const char *name : pictures)
+    {
+        String path = String("/") + name + ".raw";
+        HOST_CHECK(host_fs_copy((String("data") + path).c_str(), path.c_str()));
+    }
+    HOST_CHECK(host_fs_copy("data/playlist.txt", "/playlist.txt"));
+    catalog.begin(SPIFFS);
+    server_begin();
+    const AsyncWebRoute *index = server.route("/index.html");
+    HOST_CHECK(index != nullptr);
+    host_latency.flashReadNsPerByte = FLASH_NS_PER_BYTE;
+
+    Run before = measure(baseline::sendFileTemplate);
+    Run after = measure(index->request);
+    print("file+scan", before);
+    print("template", after);
+
+    // Same page apart from the whitespace the two file lists put between items
+    for (const char *name : pictures)
+    {
+        String link = String("<a href=\"/res/") + name + ".raw\">";
+        HOST_CHECK(before.body.indexOf(link) >= 0);
+        HOST_CHECK(after.body.indexOf(link) >= 0);
+    }
+    HOST_CHECK(after.body.indexOf("Hello, Timon") >= 0);
+    HOST_CHECK(after.flashBytes == 0);
+    HOST_CHECK(after.rps > before.rps);
+    return host_finish("index_page");
+}
@@ -0,0 +1,100 @@
+// What an idle loop() iteration spends on finding the background: /background read from flash every time as before,
+// against the config store's change flag and an in-memory lookup only after a change
+#include "../global.h"
+#include "host.h"
+
+#define FLASH_NS_PER_BYTE 300 // about 3.3 MB/s out of LittleFS
+#define FLASH_OPEN_US 150     // open() walks the root directory's metadata pair
+#define ITERATIONS 2000
+#define CHANGE_EVERY 500 // the background is set over HTTP now and then
+
+// What on_config_change() in starter.ino does for the background
+static std::atomic<bool> backgroundChanged(true);
+
+struct Run
+{
+    double usPerLoop;
+    double opensPerLoop;
+    double flashBytesPerLoop;
+    double allocationsPerLoop;
+    uint32_t lookups;
+};
+
+Run measure(std::function<bool(String &)> lookup)
+{
+    static const char *backgrounds[] = {"/noneofmy.raw", "/moveit.raw"};
+    String path;
+    Run run = {};
+    config.set("background", backgrounds[0]);
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        if (i % CHANGE_EVERY == CHANGE_EVERY - 1)
+        {
+            // The HTTP handler's write is not the loop's time
+            uint64_t changeStart = host_now_us();
+            uint64_t opens = host_counters.flashOpens, bytes = host_counters.flashReadBytes;
+            uint64_t allocations = host_counters.allocations;
+            config.set("background", backgrounds[(i / CHANGE_EVERY + 1) % 2]);
+            start += host_now_us() - changeStart;
+            host_counters.flashOpens = opens;
+            host_counters.flashReadBytes = bytes;
+            host_counters.allocations = allocations;
+        }
+        run.lookups += lookup(path);
+        HOST_CHECK(path == backgrounds[(i + 1) / CHANGE_EVERY % 2]);
+    }
+    uint64_t total = host_now_us() - start;
+    run.usPerLoop = (double)total / ITERATIONS;
+    run.opensPerLoop = (double)host_counters.flashOpens / ITERATIONS;
+    run.flashBytesPerLoop = (double)host_counters.flashReadBytes / ITERATIONS;
+    run.allocationsPerLoop = (double)host_counters.allocations / ITERATIONS;
+    return run;
+}
+
+void print(const char *name, const Run &run)
+{
+    printf("%-7s %8.2fus/loop opens=%.3f flash=%6.2f bytes allocations=%.3f lookups=%u\n", name, run.usPerLoop,
+           run.opensPerLoop, run.flashBytesPerLoop, run.allocationsPerLoop, run.lookups);
+}
+
+int main()
+{
+    catalog.begin(SPIFFS);
+    config.begin(SPIFFS);
+    config.onChange([](const char *key)
+                    {
+                        if (strcmp(key, "background") == 0)
+                        {
+                            backgroundChanged = true;
+                        } });
+    host_latency.flashReadNsPerByte = FLASH_NS_PER_BYTE;
+    host_latency.flashOpenUs = FLASH_OPEN_US;
+
+    // Before: every iteration opened and read /background, redrawing only when the path differed
+    Run before = measure([](String &path)
+                         {
+                             String read;
+                             readFileToString(SPIFFS, "/background", read);
+                             bool changed = read != path;
+                             path = read;
+                             return changed; });
+    // After: loop() reads the store only when the listener flagged a change
+    Run after = measure([](String &path)
+                        {
+                            if (!backgroundChanged.exchange(false))
+                            {
+                                return false;
+                            }
+                            path = config.getString("background");
+                            return true; });
+    print("file", before);
+    print("config", after);
+
+    HOST_CHECK(before.opensPerLoop == 1);
+    HOST_CHECK(after.opensPerLoop == 0 && after.flashBytesPerLoop == 0);
+    HOST_CHECK(after.lookups <= ITERATIONS / CHANGE_EVERY + 1);
+    HOST_CHECK(after.usPerLoop < before.usPerLoop);
+    return host_finish("loop_config");
+}
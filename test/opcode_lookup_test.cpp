@@ -0,0 +1,75 @@
+// Opcode lookup through the perfect hash table against the strcmp chain it replaced, over a few thousand command lines
+#include "../global.h"
+#include "host.h"
+
+#define LINES 8192
+#define ROUNDS 50
+
+// The old instructionFromString(): one strcmp per instruction in declaration order until one matches
+uint8_t chainFind(const char *command)
+{
+    for (size_t i = 0; i < Instructions::SIZE; i++)
+    {
+        if (strcmp(command, Instructions::names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return REGISTRY_EMPTY_SLOT;
+}
+
+int main()
+{
+    // Every name maps to its opcode, unknown names, prefixes and longer names do not
+    for (size_t i = 0; i < Instructions::SIZE; i++)
+    {
+        const char *name = Instructions::names[i];
+        HOST_CHECK(Instructions::find(name, strlen(name)) == i);
+        HOST_CHECK(Instructions::find(name, strlen(name) - 1) == REGISTRY_EMPTY_SLOT);
+        String longer = String(name) + "x";
+        HOST_CHECK(Instructions::find(longer.c_str(), longer.length()) == REGISTRY_EMPTY_SLOT);
+    }
+    HOST_CHECK(Instructions::find("", 0) == REGISTRY_EMPTY_SLOT);
+    HOST_CHECK(Instructions::find("display", 7) == REGISTRY_EMPTY_SLOT);
+
+    // Command names as they come out of a script, one in 16 is a typo
+    std::vector<std::string> commands;
+    for (int i = 0; i < LINES; i++)
+    {
+        std::string name = Instructions::names[(i * 7) % Instructions::SIZE];
+        if (i % 16 == 0)
+        {
+            name += "_typo";
+        }
+        commands.push_back(name);
+    }
+
+    uint32_t chainSum = 0, hashSum = 0;
+    uint64_t start = host_now_us();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (const std::string &command : commands)
+        {
+            chainSum += chainFind(command.c_str());
+        }
+    }
+    uint64_t chainUs = host_now_us() - start;
+
+    start = host_now_us();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (const std::string &command : commands)
+        {
+            hashSum += Instructions::find(command.data(), command.size());
+        }
+    }
+    uint64_t hashUs = host_now_us() - start;
+
+    uint32_t lookups = LINES * ROUNDS;
+    printf("%u lookups over %u instructions\n", lookups, (unsigned)Instructions::SIZE);
+    printf("strcmp chain: %6lluus, %.1fns per line\n", chainUs, chainUs * 1000.0 / lookups);
+    printf("perfect hash: %6lluus, %.1fns per line\n", hashUs, hashUs * 1000.0 / lookups);
+    HOST_CHECK(chainSum == hashSum);
+    HOST_CHECK(hashUs < chainUs);
+    return host_finish("opcode_lookup");
+}
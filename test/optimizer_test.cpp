@@ -0,0 +1,57 @@
+// The SPI bytes the optimizer claims for dropped fills against the bytes the panel really receives, with and without a framebuffer
+#include "../global.h"
+#include "host.h"
+
+#define SCRIPT "display_fill_screen: red\ndisplay_fill_screen: blue\ndisplay_cursor: 10,10\ndisplay_println: hi"
+
+std::unique_ptr<Program> compile()
+{
+    std::unique_ptr<Program> program(new Program());
+    splitView(std::string_view(SCRIPT), '\n',
+              [&program](std::string_view line)
+              {
+                  HOST_CHECK(compileInstruction(*program, line));
+              });
+    return program;
+}
+
+// Bytes sent to the panel for the program, including the flush loop() does afterwards
+uint64_t spiBytes(const Program &program)
+{
+    Register reg;
+    ProgramCursor cursor(program);
+    host_counters_reset();
+    while (!cursor.atEnd())
+    {
+        HOST_CHECK(executeInstruction(reg, cursor));
+    }
+    display.flushDamage();
+    return host_counters.spiBytes;
+}
+
+void check(const char *mode)
+{
+    std::unique_ptr<Program> original = compile();
+    std::unique_ptr<Program> optimized = compile();
+    OptimizerStats stats = optimizeProgram(*optimized);
+    HOST_CHECK(stats.before == 4 && stats.after < stats.before);
+
+    uint64_t before = spiBytes(*original);
+    uint64_t after = spiBytes(*optimized);
+    printf("%-10s panel bytes %6llu -> %6llu, optimizer claims %u saved\n", mode, before, after, stats.spiBytes);
+    HOST_CHECK(before - after == stats.spiBytes);
+}
+
+int main()
+{
+    // Drawing straight to the panel every fill is a full screen transfer
+    check("direct");
+    HOST_CHECK(!display.isBuffered());
+
+    // Into the framebuffer the dropped fill only touched RAM, the flush sends the damaged bands once
+    host_heap.internalFree = 320 * 1024;
+    HOST_CHECK(display.begin());
+    HOST_CHECK(display.isBuffered());
+    check("buffered");
+    return host_finish("optimizer");
+}
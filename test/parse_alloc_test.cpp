@@ -0,0 +1,93 @@
+// Heap allocations per command line: String substrings and one object per line before, string_view into a Program now
+#include "baseline/object_vm.h"
+#include "host.h"
+
+#define SCRIPT_LINES 4000
+
+static const char *lines[] = {
+    "display_cursor: 10, 120",
+    "display_text_color: green",
+    "display_text_size: 2",
+    "display_println: temperature 21.5 C",
+    "write_register: {\"temp\":21.5}",
+    "console_println: sensor update done",
+};
+static const size_t LINE_KINDS = sizeof(lines) / sizeof(lines[0]);
+
+// The line as string_split() handed it over, a copy out of the request parameter
+uint64_t allocationsBefore(const String &script, const char *line)
+{
+    int at = script.indexOf(line);
+    host_counters_reset();
+    String copy = script.substring(at, at + strlen(line));
+    baseline::Instruction *instruction = baseline::instructionFromString(copy);
+    uint64_t allocations = host_counters.allocations;
+    delete instruction;
+    return allocations;
+}
+
+uint64_t allocationsAfter(Program &program, const char *line)
+{
+    host_counters_reset();
+    HOST_CHECK(compileInstruction(program, std::string_view(line)));
+    return host_counters.allocations;
+}
+
+int main()
+{
+    String script;
+    for (int i = 0; i < SCRIPT_LINES; i++)
+    {
+        script += lines[i % LINE_KINDS];
+        script += "\n";
+    }
+
+    // A Program reserved for the script does not grow while the lines are compiled, the string index is
+    // allocated with the first string and doubles now and then
+    Program program;
+    program.reserve(script.length());
+    program.intern("", 0);
+    printf("%-40s before after\n", "line");
+    for (const char *line : lines)
+    {
+        uint64_t before = allocationsBefore(script, line);
+        uint64_t after = allocationsAfter(program, line);
+        printf("%-40s %6llu %5llu\n", line, before, after);
+        HOST_CHECK(after == 0);
+        HOST_CHECK(before >= 2);
+    }
+
+    // Whole script the way /command handled it then and now
+    host_counters_reset();
+    uint32_t objects = 0;
+    baseline::string_split(script, '\n',
+                           [&objects](const String &line)
+                           {
+                               if (!line.isEmpty())
+                               {
+                                   delete baseline::instructionFromString(line);
+                                   objects++;
+                               }
+                           });
+    uint64_t scriptBefore = host_counters.allocations;
+
+    host_counters_reset();
+    std::unique_ptr<Program> compiled(new Program());
+    compiled->reserve(script.length());
+    splitView(std::string_view(script.c_str(), script.length()), '\n',
+              [&compiled](std::string_view line)
+              {
+                  if (!line.empty())
+                  {
+                      compileInstruction(*compiled, line);
+                  }
+              });
+    uint64_t scriptAfter = host_counters.allocations;
+
+    printf("%u lines: before %llu allocations (%.2f per line), after %llu (%.4f per line)\n", SCRIPT_LINES,
+           scriptBefore, (double)scriptBefore / SCRIPT_LINES, scriptAfter, (double)scriptAfter / SCRIPT_LINES);
+    HOST_CHECK(objects == SCRIPT_LINES);
+    HOST_CHECK(compiled->count() == SCRIPT_LINES);
+    HOST_CHECK(scriptAfter <= 8);
+    return host_finish("parse_alloc");
+}
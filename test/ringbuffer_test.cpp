@@ -0,0 +1,154 @@
+// Producer task against a slower consumer for every overflow policy: order, push and drop counters, high water mark
+#include <Arduino.h>
+#include "../vm/ringbuffer.h"
+#include "host.h"
+
+#define ITEMS 20000
+#define CAPACITY 16
+#define STALL_EVERY 64 // entries the consumer takes before it stalls
+#define STALL_US 2000
+
+struct Item
+{
+    uint32_t sequence;
+};
+
+template <OverflowPolicy POLICY>
+struct Stress
+{
+    RingBuffer<Item, CAPACITY, POLICY> queue;
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> rejected{0};
+    std::vector<uint32_t> received;
+
+    static void producer(void *arg)
+    {
+        Stress *stress = (Stress *)arg;
+        for (uint32_t i = 0; i < ITEMS; i++)
+        {
+            if (!stress->queue.push(std::unique_ptr<Item>(new Item{i})))
+            {
+                stress->rejected++;
+            }
+            if (i % 16 == 0)
+            {
+                delayMicroseconds(100); // bursts of 16, about as fast as the consumer on average
+            }
+        }
+        stress->done = true;
+    }
+
+    // The consumer stalls now and then so the queue runs full
+    void run()
+    {
+        queue.attachConsumer();
+        xTaskCreate(producer, "producer", 4096, this, 1, nullptr);
+        while (!done || !queue.isEmpty())
+        {
+            if (!queue.wait(10))
+            {
+                continue;
+            }
+            for (std::unique_ptr<Item> item; (item = queue.pop());)
+            {
+                received.push_back(item->sequence);
+                if (received.size() % STALL_EVERY == 0)
+                {
+                    delayMicroseconds(STALL_US);
+                }
+            }
+        }
+    }
+
+    bool inOrder() const
+    {
+        for (size_t i = 1; i < received.size(); i++)
+        {
+            if (received[i] <= received[i - 1])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void print(const char *name) const
+    {
+        printf("%-11s received=%5u pushed=%5u dropped=%5u rejected=%5u high_water=%u\n", name, (unsigned)received.size(),
+               queue.pushCount(), queue.dropCount(), rejected.load(), queue.highWaterMark());
+    }
+};
+
+void testRejectNew()
+{
+    Stress<OverflowPolicy::REJECT_NEW> stress;
+    stress.run();
+    stress.print("REJECT_NEW");
+    // Rejected pushes are the only loss, whatever was accepted arrives in order
+    HOST_CHECK(stress.inOrder());
+    HOST_CHECK(stress.queue.dropCount() > 0);
+    HOST_CHECK(stress.queue.dropCount() == stress.rejected);
+    HOST_CHECK(stress.queue.pushCount() == stress.received.size());
+    HOST_CHECK(stress.received.size() + stress.queue.dropCount() == ITEMS);
+    HOST_CHECK(stress.queue.highWaterMark() == CAPACITY);
+    HOST_CHECK(stress.received.front() == 0);
+}
+
+void testDropOldest()
+{
+    Stress<OverflowPolicy::DROP_OLDEST> stress;
+    stress.run();
+    stress.print("DROP_OLDEST");
+    // Every push succeeds, evicted entries are the loss, the newest entry always arrives
+    HOST_CHECK(stress.inOrder());
+    HOST_CHECK(stress.rejected == 0);
+    HOST_CHECK(stress.queue.dropCount() > 0);
+    HOST_CHECK(stress.queue.pushCount() == ITEMS);
+    HOST_CHECK(stress.received.size() + stress.queue.dropCount() == ITEMS);
+    HOST_CHECK(stress.queue.highWaterMark() == CAPACITY);
+    HOST_CHECK(stress.received.back() == ITEMS - 1);
+}
+
+void testBlock()
+{
+    // Stalls far below VM_QUEUE_BLOCK_MS: the producer waits, nothing is lost
+    Stress<OverflowPolicy::BLOCK> stress;
+    stress.run();
+    stress.print("BLOCK");
+    HOST_CHECK(stress.rejected == 0);
+    HOST_CHECK(stress.queue.dropCount() == 0);
+    HOST_CHECK(stress.queue.pushCount() == ITEMS);
+    HOST_CHECK(stress.received.size() == ITEMS);
+    for (uint32_t i = 0; i < stress.received.size(); i++)
+    {
+        if (stress.received[i] != i)
+        {
+            HOST_CHECK(stress.received[i] == i);
+            break;
+        }
+    }
+    HOST_CHECK(stress.queue.highWaterMark() == CAPACITY);
+
+    // Without a consumer the push gives up after VM_QUEUE_BLOCK_MS and counts a drop
+    RingBuffer<Item, CAPACITY, OverflowPolicy::BLOCK> stalled;
+    for (uint32_t i = 0; i < CAPACITY; i++)
+    {
+        HOST_CHECK(stalled.push(std::unique_ptr<Item>(new Item{i})));
+    }
+    uint64_t start = host_now_us();
+    HOST_CHECK(!stalled.push(std::unique_ptr<Item>(new Item{CAPACITY})));
+    uint64_t waitedMs = (host_now_us() - start) / 1000;
+    printf("BLOCK       full queue gave up after %llums\n", waitedMs);
+    HOST_CHECK(waitedMs >= VM_QUEUE_BLOCK_MS);
+    HOST_CHECK(stalled.dropCount() == 1);
+    HOST_CHECK(stalled.size() == CAPACITY);
+    HOST_CHECK(stalled.pop()->sequence == 0);
+}
+
+int main()
+{
+    testRejectNew();
+    testDropOldest();
+    testBlock();
+    return host_finish("ringbuffer");
+}
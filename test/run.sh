@@ -0,0 +1,32 @@
+#!/bin/sh
+# Builds and runs the host tests and benchmarks against the stand-ins in test/host.
+#   test/run.sh                 all of test/*_test.cpp
+#   test/run.sh ringbuffer vm   only test/ringbuffer_test.cpp and test/vm_test.cpp
+# CXX, CXXFLAGS and BUILD_DIR override the defaults, HOST_VERBOSE=1 shows the sketch's Serial output.
+# Warnings are on as in the Arduino build, except unused parameters (callback signatures) and printf formats, which
+# differ on the host where long and size_t are 64 bit.
+cd "$(dirname "$0")/.." || exit 1
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=gnu++17 -O2 -g -pthread -fno-rtti -Wall -Wextra -Wno-unused-parameter -Wno-format}
+BUILD_DIR=${BUILD_DIR:-/tmp/host-tests}
+mkdir -p "$BUILD_DIR"
+
+if [ $# -eq 0 ]; then
+  set -- $(ls test/*_test.cpp | sed 's|test/\(.*\)_test.cpp|\1|')
+fi
+
+failed=""
+for name in "$@"; do
+  echo "== $name"
+  if ! $CXX $CXXFLAGS -Itest/host "test/${name}_test.cpp" test/host/host.cpp -o "$BUILD_DIR/$name"; then
+    failed="$failed $name"
+  elif ! "$BUILD_DIR/$name"; then
+    failed="$failed $name"
+  fi
+done
+
+if [ -n "$failed" ]; then
+  echo "failed:$failed"
+  exit 1
+fi
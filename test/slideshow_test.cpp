@@ -0,0 +1,85 @@
+// A playlist whose cycle is longer than 32 bit microseconds can count (about 71 minutes) on the fake clock: the schedule,
+// the clamped durations and the reported jitter stay right past that point. A frame that overruns its slot drops the
+// ones whose slots passed and the show stays on its schedule. The prefetch task's stack is checked after a decode.
+#include "../global.h"
+#include "host.h"
+
+#include <thread>
+
+#define MINUTE_MS (60 * 1000)
+
+bool writePlaylist(const char *path, const char *text)
+{
+    File file = SPIFFS.open(path, "w");
+    bool written = file && file.print(text) == strlen(text);
+    file.close();
+    return written;
+}
+
+bool reports(const char *part)
+{
+    String json;
+    slideshow.appendJson(json);
+    return json.indexOf(part) >= 0;
+}
+
+int main()
+{
+    HOST_CHECK(host_fs_copy("data/test.raw", "/test.raw"));
+    HOST_CHECK(host_fs_copy("data/moveit.raw", "/moveit.raw"));
+    HOST_CHECK(writePlaylist("/long.txt", "/test.raw 2400000\n/moveit.raw 7200000\n/test.raw\n"));
+    catalog.begin(SPIFFS);
+    host_clock_fake(true);
+    slideshow.begin();
+    HOST_CHECK(slideshow.start(SPIFFS, "/long.txt"));
+    HOST_CHECK(slideshow.isActive());
+
+    // 40 minutes, the two hours clamped to SLIDESHOW_MAX_MS, then the default second
+    HOST_CHECK(slideshow.tick() == 40 * MINUTE_MS);
+    host_clock_advance_ms(40 * MINUTE_MS);
+    HOST_CHECK(slideshow.tick() == SLIDESHOW_MAX_MS);
+    host_clock_advance_ms(SLIDESHOW_MAX_MS);
+    HOST_CHECK(slideshow.tick() == SLIDESHOW_DEFAULT_MS);
+
+    // 101 minutes in, past where 32 bit microseconds wrap: the next cycle is on time and nothing is dropped
+    HOST_CHECK(slideshow.tick() == SLIDESHOW_DEFAULT_MS);
+    host_clock_advance_ms(SLIDESHOW_DEFAULT_MS);
+    HOST_CHECK(slideshow.tick() == 40 * MINUTE_MS);
+    host_clock_advance_ms(40 * MINUTE_MS + 500);
+    HOST_CHECK(slideshow.tick() == SLIDESHOW_MAX_MS - 500);
+    HOST_CHECK(slideshow.shown() == 5 && slideshow.dropped() == 0);
+    HOST_CHECK(reports("\"jitter_max_us\":500000"));
+
+    // Held back for more than a cycle the show continues from here instead of dropping its way through
+    host_clock_advance_ms(7 * 60 * MINUTE_MS);
+    HOST_CHECK(slideshow.tick() == SLIDESHOW_DEFAULT_MS);
+    HOST_CHECK(slideshow.dropped() == 0);
+
+    // One second frames where showing the first one takes 2.5s: the second is dropped, the third is shown 500ms late
+    // and the fourth is due on the original schedule
+    HOST_CHECK(writePlaylist("/fps.txt", "fps 1\n/test.raw\n/moveit.raw\n/test.raw\n/moveit.raw\n"));
+    HOST_CHECK(slideshow.start(SPIFFS, "/fps.txt"));
+    HOST_CHECK(slideshow.tick() == 1000);
+    host_clock_advance_ms(2500);
+    HOST_CHECK(slideshow.tick() == 500);
+    HOST_CHECK(slideshow.shown() == 2 && slideshow.dropped() == 1);
+    HOST_CHECK(reports("\"jitter_max_us\":500000"));
+    host_clock_advance_ms(500);
+    HOST_CHECK(slideshow.tick() == 1000);
+    host_clock_advance_ms(1000);
+    HOST_CHECK(slideshow.tick() == 1000);
+    HOST_CHECK(slideshow.shown() == 4 && slideshow.dropped() == 1);
+    HOST_CHECK(reports("\"jitter_avg_us\":125000"));
+
+    // The prefetches above ran on the task's own stack, a 2 KB decoder input buffer and all
+    for (int i = 0; i < 200 && !slideshow.prefetchStackLeft(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    printf("prefetch stack: %u of %u bytes never used\n", slideshow.prefetchStackLeft(), SLIDESHOW_PREFETCH_STACK);
+    HOST_CHECK(slideshow.prefetchStackLeft() >= SLIDESHOW_PREFETCH_STACK_LOW);
+
+    slideshow.stop();
+    HOST_CHECK(!slideshow.isActive() && slideshow.tick() == UINT32_MAX);
+    return host_finish("slideshow");
+}
@@ -0,0 +1,113 @@
+// One line of text per size as display_text_benchmark() draws it on the device: glyph by glyph through
+// Adafruit_GFX::write(), against FrameBuffer::write() in runs with the glyph cache cold and warm, drawing directly and
+// into the framebuffer. Panel time is modelled from the bytes and address windows the stand-in panel counted, host
+// time is what the drawing code itself took. The host font is blank, opaque text costs the same either way.
+#include "../global.h"
+#include "host.h"
+
+#include <functional>
+
+#define LINE "Hello Handsome! 0123456789"
+#define SPI_NS_PER_BYTE 200 // 40 MHz SPI clock
+#define SPI_WINDOW_NS 4000  // CASET, RASET and RAMWR with their parameters: five small transfers and the DC switches
+#define REPEATS 20
+
+struct Run
+{
+    double hostUs;
+    double windows;
+    double bytes;
+
+    double panelUs() const { return (bytes * SPI_NS_PER_BYTE + windows * SPI_WINDOW_NS) / 1000; }
+    double totalUs() const { return hostUs + panelUs(); }
+};
+
+Run measure(std::function<void(int)> draw)
+{
+    Run run = {};
+    for (int i = 0; i < REPEATS; i++)
+    {
+        host_counters_reset();
+        uint64_t start = host_now_us();
+        draw(i);
+        run.hostUs += host_now_us() - start;
+        run.windows += host_counters.spiWindows;
+        run.bytes += host_counters.spiBytes;
+    }
+    run.hostUs /= REPEATS;
+    run.windows /= REPEATS;
+    run.bytes /= REPEATS;
+    return run;
+}
+
+void print(uint8_t size, const char *mode, const char *path, const Run &run)
+{
+    printf("%4u %-8s %-8s %9.1f %8.0f %8.0f %9.1f %9.1f\n", size, mode, path, run.hostUs, run.windows, run.bytes,
+           run.panelUs(), run.totalUs());
+}
+
+// The line through FrameBuffer::write(), `background` picks the glyph cache entries
+void drawBatched(uint8_t size, uint16_t background)
+{
+    display.setTextColor(ST77XX_WHITE, background);
+    display.setTextSize(size);
+    display.setCursor(0, 0);
+    display.print(LINE);
+    display.flushDamage();
+}
+
+// The line through Adafruit_GFX::write() on the panel, the same with or without the framebuffer
+Run drawGlyphs(uint8_t size)
+{
+    Run run = measure([size](int)
+                      {
+                          tft.setTextColor(ST77XX_WHITE, ST77XX_BLACK);
+                          tft.setTextSize(size);
+                          tft.setCursor(0, 0);
+                          tft.print(LINE); });
+    print(size, "panel", "glyphs", run);
+    return run;
+}
+
+void compare(const char *mode, const Run *glyphRuns)
+{
+    for (uint8_t size = 1; size <= 4; size++)
+    {
+        const Run &glyphs = glyphRuns[size - 1];
+        // A background no earlier run used: only the characters repeated within the line hit the cache
+        Run uncached = measure([size](int i)
+                               { drawBatched(size, 1 + i); });
+        drawBatched(size, ST77XX_BLACK);
+        Run cached = measure([size](int)
+                             { drawBatched(size, ST77XX_BLACK); });
+        print(size, mode, "uncached", uncached);
+        print(size, mode, "cached", cached);
+
+        // Per glyph every font pixel (scaled: block) and the spacing column set their own address window, batched
+        // it is one per line the text wraps to
+        uint32_t lines = (strlen(LINE) * TEXT_GLYPH_WIDTH * size + TFT_WIDTH - 1) / TFT_WIDTH;
+        HOST_CHECK(glyphs.windows == strlen(LINE) * (5 * TEXT_GLYPH_HEIGHT + 1));
+        HOST_CHECK(uncached.windows <= lines && cached.windows <= lines);
+        HOST_CHECK(cached.totalUs() < glyphs.totalUs() && uncached.totalUs() < glyphs.totalUs());
+    }
+}
+
+int main()
+{
+    printf("size mode     path       host_us  windows    bytes  panel_us  total_us\n");
+    Run glyphs[4];
+    for (uint8_t size = 1; size <= 4; size++)
+    {
+        glyphs[size - 1] = drawGlyphs(size);
+    }
+    compare("direct", glyphs);
+    HOST_CHECK(!display.isBuffered());
+
+    host_heap.internalFree = 320 * 1024;
+    HOST_CHECK(display.begin());
+    compare("buffered", glyphs);
+    printf("glyph cache: %u bytes, %u hits, %u misses\n", display.glyphCache().bytes(), display.glyphCache().hits(),
+           display.glyphCache().misses());
+    HOST_CHECK(display.glyphCache().hits() > 0);
+    return host_finish("text_render");
+}
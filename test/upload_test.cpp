@@ -0,0 +1,108 @@
+// 108KB .raw uploads through /upload: block sized writes from UploadWriter against one write per TCP chunk as before
+#include "../global.h"
+#include "host.h"
+
+#define FLASH_WRITE_NS_PER_BYTE 1000 // about 1 MB/s to program NOR flash
+#define FLASH_WRITE_CALL_US 400      // per write() call: LittleFS reads back, erases or commits the partial block
+
+struct Run
+{
+    uint32_t writes;
+    uint32_t us;
+    double kbps;
+};
+
+std::vector<uint8_t> readHost(const char *path)
+{
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path, "rb");
+    uint8_t buffer[4096];
+    for (size_t n; f && (n = fread(buffer, 1, sizeof(buffer), f)) > 0;)
+    {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return data;
+}
+
+Run finishRun(uint64_t start, size_t bytes)
+{
+    Run run;
+    run.us = host_now_us() - start;
+    run.writes = host_counters.flashWrites;
+    run.kbps = bytes * 1e6 / 1024 / run.us;
+    return run;
+}
+
+// The handler before UploadWriter: every chunk went straight to file.write()
+Run uploadDirect(const std::vector<uint8_t> &data, size_t chunk)
+{
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    File file = SPIFFS.open("/direct.raw", "w");
+    for (size_t index = 0; index < data.size(); index += chunk)
+    {
+        file.write(data.data() + index, min(chunk, data.size() - index));
+    }
+    file.close();
+    return finishRun(start, data.size());
+}
+
+// The /upload route as AsyncWebServer calls it, the length and CRC are checked before the rename
+Run uploadRoute(const std::vector<uint8_t> &data, size_t chunk, const char *path, const String &crc)
+{
+    const AsyncWebRoute *route = server.route("/upload");
+    AsyncWebServerRequest request;
+    request.addParam("file", path);
+    request.addParam("length", String((unsigned)data.size()));
+    request.addParam("crc", crc);
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    for (size_t index = 0; index < data.size(); index += chunk)
+    {
+        size_t length = min(chunk, data.size() - index);
+        route->upload(&request, "picture.raw", index, (uint8_t *)data.data() + index, length, index + length == data.size());
+    }
+    return finishRun(start, data.size());
+}
+
+int main()
+{
+    catalog.begin(SPIFFS);
+    server_begin();
+    HOST_CHECK(server.route("/upload") != nullptr);
+
+    std::vector<uint8_t> data = readHost("data/moveit.raw");
+    HOST_CHECK(data.size() == 108800);
+    char crc[16];
+    snprintf(crc, sizeof(crc), "%08x", esp_rom_crc32_le(0, data.data(), data.size()));
+
+    host_latency.flashWriteNsPerByte = FLASH_WRITE_NS_PER_BYTE;
+    host_latency.flashWriteCallUs = FLASH_WRITE_CALL_US;
+    size_t chunks[] = {1436, 536};
+    for (size_t chunk : chunks)
+    {
+        Run direct = uploadDirect(data, chunk);
+        Run coalesced = uploadRoute(data, chunk, "/moveit.raw", crc);
+        printf("%4u byte chunks: direct %3u writes %6uus %6.0f KB/s, coalesced %3u writes %6uus %6.0f KB/s\n", (unsigned)chunk,
+               direct.writes, direct.us, direct.kbps, coalesced.writes, coalesced.us, coalesced.kbps);
+        HOST_CHECK(coalesced.writes == (data.size() + UPLOAD_BUFFER_SIZE - 1) / UPLOAD_BUFFER_SIZE);
+        HOST_CHECK(coalesced.us < direct.us);
+    }
+    host_latency = HostLatency();
+
+    // The file arrived intact and the temporary file is gone
+    String hostPath = String(host_fs_root()) + "/moveit.raw";
+    HOST_CHECK(readHost(hostPath.c_str()) == data);
+    HOST_CHECK(!SPIFFS.exists("/moveit.raw" UPLOAD_TEMP_SUFFIX));
+
+    // A wrong CRC keeps the old file
+    std::vector<uint8_t> other = readHost("data/lunch.raw");
+    uploadRoute(other, 1436, "/moveit.raw", crc);
+    HOST_CHECK(readHost(hostPath.c_str()) == data);
+    HOST_CHECK(!SPIFFS.exists("/moveit.raw" UPLOAD_TEMP_SUFFIX));
+    return host_finish("upload");
+}
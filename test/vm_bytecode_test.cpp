@@ -0,0 +1,219 @@
+// Bytecode programs against the old object-per-line path on large scripts, and the limits of the 16 bit string pool
+#include "baseline/object_vm.h"
+#include "host.h"
+
+#define SCRIPT_LINES 4000
+#define ROUNDS 5
+
+// Text, cursor and register lines as a dashboard script would send them, texts repeat every 50 lines
+String script(int lines)
+{
+    static const char *colors[] = {"red", "green", "blue", "white"};
+    String text;
+    text.reserve(lines * 32);
+    for (int i = 0; i < lines; i++)
+    {
+        switch (i % 6)
+        {
+        case 0:
+            text += "display_cursor: 10," + String(10 + i % 150) + "\n";
+            break;
+        case 1:
+            text += String("display_text_color: ") + colors[i % 4] + "\n";
+            break;
+        case 2:
+            text += "display_text_size: " + String(1 + i % 3) + "\n";
+            break;
+        case 3:
+            text += "display_println: sensor " + String(i % 50) + " ok\n";
+            break;
+        case 4:
+            text += "write_register: value " + String(i % 50) + "\n";
+            break;
+        default:
+            text += "console_println: line " + String(i % 50) + "\n";
+            break;
+        }
+    }
+    return text;
+}
+
+struct Run
+{
+    uint64_t compileUs;
+    uint64_t runUs; // VM::run(): optimizer, dispatch, profiler and flush
+    uint64_t allocations;
+    uint64_t optimizeUs;
+    uint64_t dispatchUs; // the optimized program through executeInstruction() alone
+};
+
+Run runObjects(const String &command)
+{
+    baseline::ObjectVM objects;
+    Run run;
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    objects.compile(command);
+    run.compileUs = host_now_us() - start;
+    HOST_CHECK(objects.instructions.size() == SCRIPT_LINES);
+    start = host_now_us();
+    objects.run();
+    run.runUs = host_now_us() - start;
+    run.allocations = host_counters.allocations;
+    return run;
+}
+
+std::unique_ptr<Program> compile(const String &command)
+{
+    std::unique_ptr<Program> program(new Program());
+    program->reserve(command.length());
+    splitView(std::string_view(command.c_str(), command.length()), '\n',
+              [&program](std::string_view line)
+              {
+                  if (!line.empty())
+                  {
+                      HOST_CHECK(compileInstruction(*program, line));
+                  }
+              });
+    HOST_CHECK(program->count() == SCRIPT_LINES);
+    return program;
+}
+
+// Same steps as the /command route and loop(), then the parts of VM::run() on their own
+Run runBytecode(const String &command)
+{
+    Run run;
+    host_counters_reset();
+    uint64_t start = host_now_us();
+    std::unique_ptr<Program> program = compile(command);
+    HOST_CHECK(vm.queue(std::move(program)));
+    run.compileUs = host_now_us() - start;
+    start = host_now_us();
+    vm.run();
+    run.runUs = host_now_us() - start;
+    run.allocations = host_counters.allocations;
+
+    program = compile(command);
+    start = host_now_us();
+    optimizeProgram(*program);
+    run.optimizeUs = host_now_us() - start;
+    Register reg;
+    DisplayLock lock;
+    ProgramCursor cursor(*program);
+    start = host_now_us();
+    while (!cursor.atEnd() && executeInstruction(reg, cursor))
+    {
+    }
+    display.flushDamage();
+    run.dispatchUs = host_now_us() - start;
+    return run;
+}
+
+// Microseconds to intern `count` distinct strings into an empty program
+uint64_t internUs(int count)
+{
+    Program program;
+    char text[32];
+    uint64_t start = host_now_us();
+    for (int i = 0; i < count; i++)
+    {
+        int length = snprintf(text, sizeof(text), "string %d", i);
+        program.intern(text, length);
+    }
+    return host_now_us() - start;
+}
+
+void testPool()
+{
+    // Equal strings share one entry, the pool reads back what was interned
+    Program program;
+    char text[32];
+    std::vector<uint16_t> offsets;
+    for (int i = 0; i < 3000; i++)
+    {
+        int length = snprintf(text, sizeof(text), "entry %d", i);
+        offsets.push_back(program.intern(text, length));
+    }
+    size_t poolSize = program.poolSize();
+    for (int i = 0; i < 3000; i++)
+    {
+        int length = snprintf(text, sizeof(text), "entry %d", i);
+        HOST_CHECK(program.intern(text, length) == offsets[i]);
+        HOST_CHECK(strcmp(program.string(offsets[i]), text) == 0);
+    }
+    HOST_CHECK(program.poolSize() == poolSize);
+    HOST_CHECK(program.intern("entry 1", 5) != offsets[1]); // "entry" is a prefix, not a duplicate
+    HOST_CHECK(!program.overflowed());
+
+    // 7000 distinct texts need more than 64KB, the program is refused instead of reading back wrapped offsets
+    std::unique_ptr<Program> large(new Program());
+    bool compiled = true;
+    for (int i = 0; i < 7000 && compiled; i++)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "display_println: a somewhat longer status text %d", i);
+        compiled = compileInstruction(*large, line);
+    }
+    HOST_CHECK(!compiled);
+    HOST_CHECK(large->overflowed());
+    HOST_CHECK(large->poolSize() <= PROGRAM_MAX_POOL);
+    HOST_CHECK(!vm.queue(std::move(large)));
+
+    // Same for the instruction count
+    std::unique_ptr<Program> longProgram(new Program());
+    for (uint32_t i = 0; i < PROGRAM_MAX_INSTRUCTIONS; i++)
+    {
+        longProgram->emitOpcode(0);
+    }
+    HOST_CHECK(!longProgram->overflowed() && longProgram->count() == PROGRAM_MAX_INSTRUCTIONS);
+    longProgram->emitOpcode(0);
+    HOST_CHECK(longProgram->overflowed() && longProgram->count() == PROGRAM_MAX_INSTRUCTIONS);
+    HOST_CHECK(!vm.queue(std::move(longProgram)));
+}
+
+int main()
+{
+    log_setup(); // lines are drained by the log task as on the device
+    vm.begin();
+    vm.run(); // the start-up program
+
+    testPool();
+
+    uint64_t intern1k = internUs(1000);
+    uint64_t intern4k = internUs(4000);
+    uint64_t intern16k = internUs(16000);
+    printf("intern: 1000 strings %lluus, 4000 %lluus, 16000 %lluus\n", intern1k, intern4k, intern16k);
+    // Linear would be 16x, the old linear scan was quadratic (256x)
+    HOST_CHECK(intern16k < (intern1k + 10) * 40);
+
+    String command = script(SCRIPT_LINES);
+    Run objects = {}, bytecode = {};
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        Run o = runObjects(command);
+        Run b = runBytecode(command);
+        objects.compileUs += o.compileUs / ROUNDS;
+        objects.runUs += o.runUs / ROUNDS;
+        objects.allocations = o.allocations;
+        bytecode.compileUs += b.compileUs / ROUNDS;
+        bytecode.runUs += b.runUs / ROUNDS;
+        bytecode.allocations = b.allocations;
+        bytecode.optimizeUs += b.optimizeUs / ROUNDS;
+        bytecode.dispatchUs += b.dispatchUs / ROUNDS;
+    }
+    printf("%u lines, %u bytes\n", SCRIPT_LINES, command.length());
+    printf("objects:  compile=%6lluus run=%6lluus allocations=%llu\n", objects.compileUs, objects.runUs, objects.allocations);
+    printf("bytecode: compile=%6lluus run=%6lluus allocations=%llu (optimize=%lluus dispatch=%lluus)\n", bytecode.compileUs,
+           bytecode.runUs, bytecode.allocations, bytecode.optimizeUs, bytecode.dispatchUs);
+    HOST_CHECK(bytecode.compileUs < objects.compileUs);
+    HOST_CHECK(bytecode.allocations * 10 < objects.allocations);
+    // The object path has no optimizer or profiler, its run is dispatch and the same drawing
+    HOST_CHECK(bytecode.dispatchUs < objects.runUs);
+    HOST_CHECK(bytecode.runUs < objects.runUs);
+
+    // The profiler's per-run totals add up to every instruction the VM ran
+    String profile;
+    vm.stats().appendJson(profile);
+    HOST_CHECK(profile.indexOf("\"console_println\":{\"count\":" + String(SCRIPT_LINES / 6 * ROUNDS + 1)) >= 0); // and the start-up program
+    return host_finish("vm_bytecode");
+}
@@ -0,0 +1,147 @@
+// delay: suspends only its own program. Interleaved programs on a fake clock: wake times, nextWakeIn() and completion.
+#include "../global.h"
+#include "host.h"
+
+struct Completion
+{
+    uint32_t batch;
+    uint32_t at; // millis() when the listener ran
+    uint32_t durationMs;
+    uint16_t executed;
+};
+std::vector<Completion> completions;
+
+void onComplete(const ProgramResult &result)
+{
+    completions.push_back({result.batch, (uint32_t)millis(), result.durationMs, result.executed});
+}
+
+std::unique_ptr<Program> compile(const char *script, uint32_t batch)
+{
+    std::unique_ptr<Program> program(new Program());
+    splitView(std::string_view(script), '\n',
+              [&program](std::string_view line)
+              {
+                  HOST_CHECK(compileInstruction(*program, line));
+              });
+    program->tag(1, batch);
+    return program;
+}
+
+const Completion *completed(uint32_t batch)
+{
+    for (const Completion &completion : completions)
+    {
+        if (completion.batch == batch)
+        {
+            return &completion;
+        }
+    }
+    return nullptr;
+}
+
+void testInterleaved()
+{
+    uint32_t start = millis();
+    HOST_CHECK(vm.queue(compile("console_println: a1\ndelay: 100\nconsole_println: a2\ndelay: 200\nconsole_println: a3", 1)));
+    HOST_CHECK(vm.queue(compile("console_println: b1\ndelay: 150\nconsole_println: b2", 2)));
+    HOST_CHECK(vm.queue(compile("console_println: c1", 3)));
+
+    // c runs through, a and b stop at their first delay
+    vm.run();
+    HOST_CHECK(completed(3) && completed(3)->at == start && completed(3)->executed == 1);
+    HOST_CHECK(!completed(1) && !completed(2));
+    HOST_CHECK(vm.nextWakeIn() == 100);
+
+    // Nothing is due one millisecond early
+    host_clock_advance_ms(99);
+    vm.run();
+    HOST_CHECK(completions.size() == 1);
+    HOST_CHECK(vm.nextWakeIn() == 1);
+
+    // a resumes at 100 and sleeps until 300, b is next at 150
+    host_clock_advance_ms(1);
+    vm.run();
+    HOST_CHECK(completions.size() == 1);
+    HOST_CHECK(vm.nextWakeIn() == 50);
+
+    // A program queued while the others sleep runs right away
+    HOST_CHECK(vm.queue(compile("console_println: d1", 4)));
+    vm.run();
+    HOST_CHECK(completed(4) && completed(4)->at == start + 100 && completed(4)->durationMs == 0);
+    HOST_CHECK(vm.nextWakeIn() == 50);
+
+    host_clock_advance_ms(50);
+    vm.run();
+    HOST_CHECK(completed(2) && completed(2)->at == start + 150 && completed(2)->durationMs == 150 && completed(2)->executed == 3);
+    HOST_CHECK(vm.nextWakeIn() == 150);
+    HOST_CHECK(!vm.isIdle());
+
+    // Running late resumes at once and reports the real duration
+    host_clock_advance_ms(170);
+    HOST_CHECK(vm.nextWakeIn() == 0);
+    vm.run();
+    HOST_CHECK(completed(1) && completed(1)->at == start + 320 && completed(1)->durationMs == 320 && completed(1)->executed == 5);
+    HOST_CHECK(vm.nextWakeIn() == UINT32_MAX);
+    HOST_CHECK(vm.isIdle());
+}
+
+void testContextsFull()
+{
+    // VM_CONTEXTS programs sleep at once, the next one starts as soon as one of them finished
+    completions.clear();
+    uint32_t start = millis();
+    for (uint32_t i = 0; i <= VM_CONTEXTS; i++)
+    {
+        HOST_CHECK(vm.queue(compile(i == VM_CONTEXTS ? "delay: 30" : "delay: 10", 10 + i)));
+    }
+    vm.run();
+    HOST_CHECK(vm.queueDepth() == 1);
+    HOST_CHECK(vm.nextWakeIn() == 10);
+    HOST_CHECK(!vm.waitForWork(1)); // no free context, the queued program cannot start yet
+
+    host_clock_advance_ms(10);
+    vm.run();
+    HOST_CHECK(completions.size() == VM_CONTEXTS);
+    HOST_CHECK(vm.queueDepth() == 0);
+    HOST_CHECK(vm.nextWakeIn() == 30);
+    host_clock_advance_ms(30);
+    vm.run();
+    HOST_CHECK(completed(10 + VM_CONTEXTS) && completed(10 + VM_CONTEXTS)->at == start + 40);
+    HOST_CHECK(vm.isIdle());
+}
+
+void testWakeOnQueue()
+{
+    // loop() sleeps in waitForWork(), a program from the web server task wakes it long before the timeout
+    static std::atomic<uint64_t> queuedAt;
+    vm.waitForWork(0); // takes the notifications left over from the pushes above
+    xTaskCreate([](void *)
+                {
+                    delay(20);
+                    queuedAt = host_now_us();
+                    vm.queue(compile("console_println: wake", 20)); },
+                "server", 4096, nullptr, 1, nullptr);
+    uint64_t start = host_now_us();
+    HOST_CHECK(vm.waitForWork(5000));
+    uint64_t woken = host_now_us();
+    printf("waitForWork: woke %lluus after the push, %llums into a 5000ms wait\n", woken - queuedAt, (woken - start) / 1000);
+    HOST_CHECK(woken - start < 1000 * 1000);
+    vm.run();
+    HOST_CHECK(completed(20) != nullptr);
+}
+
+int main()
+{
+    vm.onComplete(onComplete);
+    vm.begin();
+    vm.run(); // the start-up program
+    completions.clear();
+
+    host_clock_fake(true);
+    testInterleaved();
+    testContextsFull();
+    host_clock_fake(false);
+    testWakeOnQueue();
+    return host_finish("vm_delay");
+}
@@ -0,0 +1,134 @@
+// /vm/ws batches: size and instruction limits, and "done" messages that go out from the outbox timer, never from loop()
+#include "../global.h"
+#include "host.h"
+
+AsyncWebSocketClient client(7);
+
+// One text frame carrying `text`, `announced` is the length the client put into the frame header
+void sendFrame(const std::string &text, uint64_t announced, uint64_t index, bool final)
+{
+    AwsFrameInfo info = {};
+    info.message_opcode = WS_TEXT;
+    info.opcode = index == 0 ? WS_TEXT : WS_CONTINUATION;
+    info.final = final;
+    info.len = announced;
+    info.index = index;
+    commandSocket.event(&client, WS_EVT_DATA, &info, (uint8_t *)text.data(), text.size());
+}
+
+void sendMessage(const std::string &text)
+{
+    sendFrame(text, text.size(), 0, true);
+}
+
+// Messages of `type` the client got since client.sent was cleared
+std::vector<std::string> received(const char *type)
+{
+    std::vector<std::string> messages;
+    std::string tag = std::string("\"type\":\"") + type + "\"";
+    for (const std::string &message : client.sent)
+    {
+        if (message.find(tag) != std::string::npos)
+        {
+            messages.push_back(message);
+        }
+    }
+    return messages;
+}
+
+bool contains(const std::string &message, const char *part)
+{
+    return message.find(part) != std::string::npos;
+}
+
+std::string repeat(const char *line, int count)
+{
+    std::string text;
+    for (int i = 0; i < count; i++)
+    {
+        text += line;
+    }
+    return text;
+}
+
+void testDoneFromOutboxTimer()
+{
+    client.sent.clear();
+    sendMessage("console_println: one\nconsole_println: two");
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"status\":\"queued\""));
+    HOST_CHECK(contains(received("ack")[0], "\"instructions\":2"));
+
+    // loop() finishes the batch, the timer it started sends the result and the queue status without any socket event
+    client.sent.clear();
+    vm.run();
+    host_timers_wait();
+    HOST_CHECK(received("done").size() == 1 && contains(received("done")[0], "\"executed\":2"));
+    HOST_CHECK(received("queue").size() == 1);
+    HOST_CHECK(client.sender != std::this_thread::get_id());
+}
+
+void testTooLarge()
+{
+    // A frame announcing 1MB is refused before anything is reserved for it
+    client.sent.clear();
+    uint32_t depth = vm.queueDepth();
+    host_counters_reset();
+    sendFrame("console_println: start\n", 1024 * 1024, 0, false);
+    HOST_CHECK(host_counters.allocations < 4);
+    sendFrame("console_println: end", 1024 * 1024, 1024 * 1024 - 20, true);
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"status\":\"too_large\""));
+    HOST_CHECK(contains(received("ack")[0], "\"max_bytes\":4096"));
+
+    // Fragmented: every frame is small, the batch is not
+    client.sent.clear();
+    std::string part = repeat("console_println: abcdefghijklmnopqrstuvwxyz\n", 40);
+    sendFrame(part, part.size(), 0, false);
+    sendFrame(part, part.size(), 0, false);
+    sendFrame(part, part.size(), 0, true);
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"too_large\""));
+
+    // Within the byte limit but over the instruction limit
+    client.sent.clear();
+    sendMessage(repeat("delay: 0\n", WS_MAX_INSTRUCTIONS + 1));
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"too_large\""));
+
+    // Exactly at the limit is fine, and nothing of the rejected batches was queued
+    client.sent.clear();
+    sendMessage(repeat("delay: 0\n", WS_MAX_INSTRUCTIONS));
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"queued\""));
+    HOST_CHECK(vm.queueDepth() == depth + 1);
+    vm.run();
+    host_timers_wait();
+}
+
+void testLongLine()
+{
+    // A line split across frames is buffered up to WS_MAX_LINE, longer ones are dropped and counted
+    client.sent.clear();
+    std::string first = "console_println: ok\nconsole_println: " + std::string(WS_MAX_LINE, 'x');
+    std::string second = "\nconsole_println: ok";
+    sendFrame(first, first.size(), 0, false);
+    sendFrame(second, second.size(), 0, true);
+    HOST_CHECK(received("ack").size() == 1 && contains(received("ack")[0], "\"queued\""));
+    HOST_CHECK(contains(received("ack")[0], "\"instructions\":2") && contains(received("ack")[0], "\"invalid\":1"));
+    vm.run();
+    host_timers_wait();
+}
+
+int main()
+{
+    vm.begin();
+    vm.run(); // the start-up program
+    catalog.begin(SPIFFS);
+    server_begin();
+
+    commandSocket.event(&client, WS_EVT_CONNECT);
+    HOST_CHECK(received("queue").size() == 1);
+
+    testDoneFromOutboxTimer();
+    testTooLarge();
+    testLongLine();
+    commandSocket.event(&client, WS_EVT_DISCONNECT);
+    HOST_CHECK(commandSessions.empty());
+    return host_finish("websocket");
+}
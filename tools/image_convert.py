@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Converts headerless RGB565 .raw files (big endian, as stored in /data and /res)
+into the image container read by ImageReader in lib_image.h.
+
+    python3 tools/image_convert.py data/test.raw data/test.img
+    python3 tools/image_convert.py --encoding rle res/red.raw res/red.img
+
+With --encoding auto (the default) the smallest of raw, rle and palette is written,
+unless it saves less than a quarter of raw: decoding a photo costs more than the
+few flash bytes it saves, see test/image_decode_test.cpp.
+"""
+import argparse
+import os
+import struct
+import sys
+
+IMAGE_MAGIC = b"R565"
+IMAGE_VERSION = 1
+IMAGE_FLAG_LITTLE_ENDIAN = 0x01
+IMAGE_ENCODING_RAW = 0
+IMAGE_ENCODING_RLE = 1
+IMAGE_ENCODING_PALETTE_RLE = 2
+IMAGE_PALETTE_SIZE = 256
+AUTO_MAX_RATIO = 0.75  # compressed payloads larger than this share of raw are written raw
+ENCODINGS = {"raw": IMAGE_ENCODING_RAW, "rle": IMAGE_ENCODING_RLE, "palette": IMAGE_ENCODING_PALETTE_RLE}
+HEADER = struct.Struct("<4sBBHHHB3x")
+
+
+def pack_header(width, height, flags, encoding=IMAGE_ENCODING_RAW):
+    return HEADER.pack(IMAGE_MAGIC, IMAGE_VERSION, flags, HEADER.size, width, height, encoding)
+
+
+def read_raw(path, width, height):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] == IMAGE_MAGIC:
+        sys.exit(f"{path} is already converted")
+    if len(data) != width * height * 2:
+        sys.exit(f"{path}: expected {width * height * 2} bytes for {width}x{height}, got {len(data)}")
+    return data
+
+
+def swap_bytes(data):
+    swapped = bytearray(data)
+    swapped[0::2] = data[1::2]
+    swapped[1::2] = data[0::2]
+    return bytes(swapped)
+
+
+def packbits(values, emit):
+    """PackBits as decoded by ImageReader: 0x80 | (n - 1) repeats one value, (n - 1) copies n values."""
+    out = bytearray()
+    i = 0
+    while i < len(values):
+        run = 1
+        while i + run < len(values) and run < 128 and values[i + run] == values[i]:
+            run += 1
+        if run > 1:
+            out.append(0x80 | (run - 1))
+            out += emit(values[i])
+            i += run
+            continue
+        start = i
+        while i < len(values) and i - start < 128:
+            if i + 1 < len(values) and values[i + 1] == values[i]:
+                break
+            i += 1
+        if i == start:
+            i += 1
+        out.append(i - start - 1)
+        for value in values[start:i]:
+            out += emit(value)
+    return bytes(out)
+
+
+def encode(pixels, encoding):
+    """Returns the payload after the header, pixels are 2 byte strings in file byte order."""
+    if encoding == IMAGE_ENCODING_RAW:
+        return b"".join(pixels)
+    if encoding == IMAGE_ENCODING_RLE:
+        return packbits(pixels, lambda p: p)
+    colors = sorted(set(pixels))
+    if len(colors) > IMAGE_PALETTE_SIZE:
+        return None
+    index = {color: i for i, color in enumerate(colors)}
+    palette = struct.pack("<H", len(colors)) + b"".join(colors)
+    return palette + packbits([index[p] for p in pixels], lambda i: bytes([i]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input")
+    parser.add_argument("output", nargs="?", help="defaults to the input with an .img extension")
+    parser.add_argument("--width", type=int, default=320)
+    parser.add_argument("--height", type=int, default=170)
+    parser.add_argument("--encoding", choices=["auto"] + list(ENCODINGS), default="auto")
+    parser.add_argument("--little-endian", action="store_true",
+                        help="store pixels LSB first (needs a swap while sending, only for testing)")
+    args = parser.parse_args()
+
+    output = args.output or os.path.splitext(args.input)[0] + ".img"
+    pixels = read_raw(args.input, args.width, args.height)
+    flags = 0
+    if args.little_endian:
+        pixels = swap_bytes(pixels)
+        flags |= IMAGE_FLAG_LITTLE_ENDIAN
+
+    values = [pixels[i:i + 2] for i in range(0, len(pixels), 2)]
+    candidates = ENCODINGS if args.encoding == "auto" else {args.encoding: ENCODINGS[args.encoding]}
+    payloads = {name: encode(values, encoding) for name, encoding in candidates.items()}
+    payloads = {name: payload for name, payload in payloads.items() if payload is not None}
+    if not payloads:
+        sys.exit(f"{args.input}: more than {IMAGE_PALETTE_SIZE} colors, palette encoding not possible")
+    name = min(payloads, key=lambda n: len(payloads[n]))
+    if args.encoding == "auto" and len(payloads[name]) > AUTO_MAX_RATIO * len(payloads["raw"]):
+        name = "raw"
+
+    with open(output, "wb") as f:
+        f.write(pack_header(args.width, args.height, flags, ENCODINGS[name]))
+        f.write(payloads[name])
+    size = HEADER.size + len(payloads[name])
+    print(f"{args.input} -> {output} ({args.width}x{args.height}, {name}, {size} bytes, "
+          f"{100 * size / len(pixels):.1f}% of raw)")
+
+
+if __name__ == "__main__":
+    main()
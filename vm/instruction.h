@@ -3,383 +3,451 @@
 
 #include <Arduino.h>
 #include "register.h"
+#include "program.h"
+#include "registry.h"
+#include "parse.h"
+#include "../lib_catalog.h"
+#include "../lib_config.h"
 #include "../lib_display.h"
+#include "../lib_log.h"
 
-class Instruction
+uint16_t colorFromName(std::string_view colorStr, uint16_t fallback)
 {
-public:
-    virtual void execute(Register &reg) = 0;
-    virtual ~Instruction() = default;
-
-    virtual const char *name();
-    static const char *NAME;
-};
+    if (colorStr == "red")
+    {
+        return ST77XX_RED;
+    }
+    else if (colorStr == "green")
+    {
+        return ST77XX_GREEN;
+    }
+    else if (colorStr == "blue")
+    {
+        return ST77XX_BLUE;
+    }
+    else if (colorStr == "white")
+    {
+        return ST77XX_WHITE;
+    }
+    else if (colorStr == "black")
+    {
+        return ST77XX_BLACK;
+    }
+    return fallback;
+}
 
-class ConsolePrintlnInstruction : public Instruction
+/**
+ * Every instruction compiles its value into operands and executes them again from the cursor.
+ * The operands read in execute() must match what compile() emitted and OPERAND_BYTES.
+ */
+class ConsolePrintlnInstruction
 {
-private:
-    String message;
-
 public:
-    ConsolePrintlnInstruction(const String &msg) : message(msg) {}
+    static constexpr uint8_t OPCODE = 0;
+    static constexpr const char *NAME = "console_println";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view msg)
     {
-        Serial.println(message);
+        program.emitOpcode(OPCODE);
+        program.emitString(msg.data(), msg.size());
     }
-    static constexpr const char *NAME = "console_println";
-    const char *name() override
+
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        LOG_INFO("%s", cursor.string());
     }
 };
 
-class DisplayPrintlnInstruction : public Instruction
+class DisplayPrintlnInstruction
 {
-private:
-    String message;
-
 public:
-    DisplayPrintlnInstruction(const String &msg) : message(msg) {}
+    static constexpr uint8_t OPCODE = 1;
+    static constexpr const char *NAME = "display_println";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view msg)
     {
-        tft.println(message);
+        program.emitOpcode(OPCODE);
+        program.emitString(msg.data(), msg.size());
     }
 
-    static constexpr const char *NAME = "display_println";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display.println(cursor.string());
     }
 };
 
-class DisplayBrightnessInstruction : public Instruction
+class DisplayBrightnessInstruction
 {
-private:
-    uint8_t brightness;
-
 public:
-    DisplayBrightnessInstruction(const String &brightnessStr) : brightness(brightnessStr.toInt()) {}
+    static constexpr uint8_t OPCODE = 2;
+    static constexpr const char *NAME = "display_brightness";
+    static constexpr uint8_t OPERAND_BYTES = 1;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view brightnessStr)
     {
-        display_brightness_set(brightness);
+        program.emitOpcode(OPCODE);
+        program.emit8(parseInt(brightnessStr));
     }
 
-    static constexpr const char *NAME = "display_brightness";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display_brightness_set(cursor.u8());
     }
 };
 
-class DisplayTextHexColorInstruction : public Instruction
+class DisplayTextHexColorInstruction
 {
-private:
-    u_int16_t color; // 16bit 565 rgb color
 public:
-    DisplayTextHexColorInstruction(const String &colorStr) : color(strtoul(colorStr.c_str(), nullptr, 16)) {}
+    static constexpr uint8_t OPCODE = 3;
+    static constexpr const char *NAME = "display_text_hexcolor";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view colorStr)
     {
-        tft.setTextColor(color);
+        program.emitOpcode(OPCODE);
+        program.emit16(parseHex(colorStr)); // 16bit 565 rgb color
     }
 
-    static constexpr const char *NAME = "display_text_hexcolor";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display.setTextColor(cursor.u16());
     }
 };
 
-class DisplayTextColorInstruction : public Instruction
+class DisplayTextColorInstruction
 {
-private:
-    uint16_t color; // 16bit 565 rgb color
 public:
-    DisplayTextColorInstruction(const String &colorStr)
-    {
-        if (colorStr.equals("red"))
-        {
-            color = ST77XX_RED;
-        }
-        else if (colorStr.equals("green"))
-        {
-            color = ST77XX_GREEN;
-        }
-        else if (colorStr.equals("blue"))
-        {
-            color = ST77XX_BLUE;
-        }
-        else if (colorStr.equals("white"))
-        {
-            color = ST77XX_WHITE;
-        }
-        else if (colorStr.equals("black"))
-        {
-            color = ST77XX_BLACK;
-        }
-        else
-        {
-            color = ST77XX_WHITE; // default to white
-        }
-    }
+    static constexpr uint8_t OPCODE = 4;
+    static constexpr const char *NAME = "display_text_color";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view colorStr)
     {
-        tft.setTextColor(color);
+        program.emitOpcode(OPCODE);
+        program.emit16(colorFromName(colorStr, ST77XX_WHITE)); // default to white
     }
 
-    static constexpr const char *NAME = "display_text_color";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display.setTextColor(cursor.u16());
     }
 };
 
-class DisplayTextSizeInstruction : public Instruction
+class DisplayTextSizeInstruction
 {
-private:
-    uint8_t size;
-
 public:
-    DisplayTextSizeInstruction(const String &sizeStr) : size(sizeStr.toInt()) {}
+    static constexpr uint8_t OPCODE = 5;
+    static constexpr const char *NAME = "display_text_size";
+    static constexpr uint8_t OPERAND_BYTES = 1;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view sizeStr)
     {
-        tft.setTextSize(size);
+        program.emitOpcode(OPCODE);
+        program.emit8(parseInt(sizeStr));
     }
 
-    static constexpr const char *NAME = "display_text_size";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display.setTextSize(cursor.u8());
     }
 };
 
-class DisplayFillScreenInstruction : public Instruction
+class DisplayFillScreenInstruction
 {
-private:
-    uint16_t color; // 16bit 565 rgb color
 public:
-    DisplayFillScreenInstruction(const String &colorStr)
-    {
-        if (colorStr.equals("red"))
-        {
-            color = ST77XX_RED;
-        }
-        else if (colorStr.equals("green"))
-        {
-            color = ST77XX_GREEN;
-        }
-        else if (colorStr.equals("blue"))
-        {
-            color = ST77XX_BLUE;
-        }
-        else if (colorStr.equals("white"))
-        {
-            color = ST77XX_WHITE;
-        }
-        else if (colorStr.equals("black"))
-        {
-            color = ST77XX_BLACK;
-        }
-        else
-        {
-            color = ST77XX_BLACK; // default to black
-        }
-    }
+    static constexpr uint8_t OPCODE = 6;
+    static constexpr const char *NAME = "display_fill_screen";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view colorStr)
     {
-        tft.fillScreen(color);
+        program.emitOpcode(OPCODE);
+        program.emit16(colorFromName(colorStr, ST77XX_BLACK)); // default to black
     }
 
-    static constexpr const char *NAME = "display_fill_screen";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        display.fillScreen(cursor.u16());
     }
 };
 
-class DisplayCursorInstruction : public Instruction
+class DisplayCursorInstruction
 {
-private:
-    int16_t x, y;
-
 public:
-    DisplayCursorInstruction(const String &coords)
+    static constexpr uint8_t OPCODE = 7;
+    static constexpr const char *NAME = "display_cursor";
+    static constexpr uint8_t OPERAND_BYTES = 4;
+
+    static void compile(Program &program, std::string_view coords)
     {
-        x = -1;
-        y = -1;
+        int16_t x = -1;
+        int16_t y = -1;
 
-        int colonIndex = coords.indexOf(',');
-        if (colonIndex != -1)
+        long parsedX, parsedY;
+        if (parseCoordinates(coords, parsedX, parsedY))
         {
-            if (coords.substring(0, colonIndex).toInt() > 0)
+            if (parsedX > 0)
             {
-                x = coords.substring(0, colonIndex).toInt();
+                x = parsedX;
             }
-            if (coords.substring(colonIndex + 1).toInt() > 0)
+            if (parsedY > 0)
             {
-                y = coords.substring(colonIndex + 1).toInt();
+                y = parsedY;
             }
         }
+
+        program.emitOpcode(OPCODE);
+        program.emit16(x);
+        program.emit16(y);
     }
 
-    void execute(Register &reg) override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
+        int16_t x = cursor.u16();
+        int16_t y = cursor.u16();
         if (x > 0)
         {
-            tft.setCursor(x, tft.getCursorY());
+            display.setCursor(x, display.getCursorY());
         }
         if (y > 0)
         {
-            tft.setCursor(tft.getCursorX(), y);
+            display.setCursor(display.getCursorX(), y);
         }
     }
-
-    static constexpr const char *NAME = "display_cursor";
-    const char *name() override
-    {
-        return NAME;
-    }
 };
 
-class DelayInstruction : public Instruction
+class DelayInstruction
 {
-private:
-    unsigned long delayTime;
-
 public:
-    DelayInstruction(String time) : delayTime(time.toInt()) {}
+    static constexpr uint8_t OPCODE = 8;
+    static constexpr const char *NAME = "delay";
+    static constexpr uint8_t OPERAND_BYTES = 4;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view time)
     {
-        delay_display(delayTime);
+        program.emitOpcode(OPCODE);
+        program.emit32(parseInt(time));
     }
 
-    static constexpr const char *NAME = "delay";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        cursor.sleep(cursor.u32());
     }
 };
 
-class WriteRegisterInstruction : public Instruction
+class WriteRegisterInstruction
 {
-private:
-    String value;
-
 public:
-    WriteRegisterInstruction(const String &val) : value(val) {}
+    static constexpr uint8_t OPCODE = 9;
+    static constexpr const char *NAME = "write_register";
+    static constexpr uint8_t OPERAND_BYTES = 2;
 
-    void execute(Register &reg) override
+    static void compile(Program &program, std::string_view val)
     {
-        reg.set(value);
+        program.emitOpcode(OPCODE);
+        program.emitString(val.data(), val.size());
     }
 
-    static constexpr const char *NAME = "write_register";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        reg.set(cursor.string());
     }
 };
 
-class WriteFileInstruction : public Instruction
+class WriteFileInstruction
 {
-private:
-    String filePath;
-
 public:
-    WriteFileInstruction(const String &path) : filePath(path) {}
-    void execute(Register &reg) override
+    static constexpr uint8_t OPCODE = 10;
+    static constexpr const char *NAME = "write_file";
+    static constexpr uint8_t OPERAND_BYTES = 2;
+
+    static void compile(Program &program, std::string_view path)
     {
-        writeFile(SPIFFS, filePath.c_str(), reg.get().c_str());
+        program.emitOpcode(OPCODE);
+        program.emitString(path.data(), path.size());
     }
 
-    static constexpr const char *NAME = "write_file";
-    const char *name() override
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return NAME;
+        const char *path = cursor.string();
+        if (config.contains(path))
+        {
+            if (!config.set(path, reg.get()))
+            {
+                LOG_WARN("Invalid value for %s: %s", path, reg.get().c_str());
+            }
+            return;
+        }
+        writeFile(SPIFFS, path, reg.get().c_str());
+        catalog.update(path);
     }
 };
 
-Instruction *instructionFromString(const String &instructionStr)
+// Cursor, text color, text size and println in one instruction, usually produced by the optimizer
+class DisplayTextInstruction
 {
-    if (instructionStr.indexOf(':') == -1)
-    {
-        Serial.printf(F("Invalid instruction format: %s\n"), instructionStr.c_str());
-        return nullptr;
-    }
-
-    String commandStr = instructionStr.substring(0, instructionStr.indexOf(':'));
-    commandStr.trim();
-    const char *command = commandStr.c_str();
-
-    String value = instructionStr.substring(instructionStr.indexOf(':') + 1);
-    value.trim();
-    Serial.printf("Parsed command: %s, value: %s\n", command, value.c_str());
+public:
+    static constexpr uint8_t OPCODE = 11;
+    static constexpr const char *NAME = "display_text";
+    static constexpr uint8_t OPERAND_BYTES = 10;
+    static constexpr uint8_t HAS_COLOR = 0x01;
+    static constexpr uint8_t HAS_SIZE = 0x02;
 
-    if (strcmp(command, ConsolePrintlnInstruction::NAME) == 0)
-    {
-        return new ConsolePrintlnInstruction(value);
-    }
-    else if (strcmp(command, DisplayPrintlnInstruction::NAME) == 0)
-    {
-        return new DisplayPrintlnInstruction(value);
-    }
-    else if (strcmp(command, DisplayBrightnessInstruction::NAME) == 0)
-    {
-        return new DisplayBrightnessInstruction(value);
-    }
-    else if (strcmp(command, DisplayTextHexColorInstruction::NAME) == 0)
+    static void emit(Program &program, uint8_t flags, int16_t x, int16_t y, uint16_t color, uint8_t size, uint16_t text)
     {
-        return new DisplayTextHexColorInstruction(value);
+        program.emitOpcode(OPCODE);
+        program.emit8(flags);
+        program.emit16(x);
+        program.emit16(y);
+        program.emit16(color);
+        program.emit8(size);
+        program.emit16(text);
     }
-    else if (strcmp(command, DisplayTextColorInstruction::NAME) == 0)
-    {
-        return new DisplayTextColorInstruction(value);
-    }
-    else if (strcmp(command, DisplayTextSizeInstruction::NAME) == 0)
-    {
-        return new DisplayTextSizeInstruction(value);
-    }
-    else if (strcmp(command, DisplayFillScreenInstruction::NAME) == 0)
+
+    // x,y,hexcolor,size,text
+    static void compile(Program &program, std::string_view value)
     {
-        return new DisplayFillScreenInstruction(value);
+        std::string_view fields[4];
+        for (std::string_view &field : fields)
+        {
+            size_t comma = value.find(',');
+            field = value.substr(0, comma);
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        }
+        long x = parseInt(fields[0]);
+        long y = parseInt(fields[1]);
+        uint16_t text = program.intern(value.data(), value.size());
+        emit(program, HAS_COLOR | HAS_SIZE, x > 0 ? x : -1, y > 0 ? y : -1, parseHex(fields[2]), parseInt(fields[3]), text);
     }
-    else if (strcmp(command, DisplayCursorInstruction::NAME) == 0)
+
+    static void execute(Register &reg, ProgramCursor &cursor)
     {
-        return new DisplayCursorInstruction(value);
+        uint8_t flags = cursor.u8();
+        int16_t x = cursor.u16();
+        int16_t y = cursor.u16();
+        uint16_t color = cursor.u16();
+        uint8_t size = cursor.u8();
+        const char *text = cursor.string();
+        if (x > 0)
+        {
+            display.setCursor(x, display.getCursorY());
+        }
+        if (y > 0)
+        {
+            display.setCursor(display.getCursorX(), y);
+        }
+        if (flags & HAS_COLOR)
+        {
+            display.setTextColor(color);
+        }
+        if (flags & HAS_SIZE)
+        {
+            display.setTextSize(size);
+        }
+        display.println(text);
     }
-    else if (strcmp(command, DelayInstruction::NAME) == 0)
+};
+
+typedef InstructionTable<
+    ConsolePrintlnInstruction,
+    DisplayPrintlnInstruction,
+    DisplayBrightnessInstruction,
+    DisplayTextHexColorInstruction,
+    DisplayTextColorInstruction,
+    DisplayTextSizeInstruction,
+    DisplayFillScreenInstruction,
+    DisplayCursorInstruction,
+    DelayInstruction,
+    WriteRegisterInstruction,
+    WriteFileInstruction,
+    DisplayTextInstruction>
+    Instructions;
+
+#define OPCODE_COUNT Instructions::SIZE
+
+const char *opcodeName(uint8_t opcode)
+{
+    return Instructions::name(opcode);
+}
+
+// Executes the instruction at the cursor, returns false for an unknown opcode
+bool executeInstruction(Register &reg, ProgramCursor &cursor)
+{
+    switch (cursor.u8())
+    {
+    case ConsolePrintlnInstruction::OPCODE:
+        ConsolePrintlnInstruction::execute(reg, cursor);
+        break;
+    case DisplayPrintlnInstruction::OPCODE:
+        DisplayPrintlnInstruction::execute(reg, cursor);
+        break;
+    case DisplayBrightnessInstruction::OPCODE:
+        DisplayBrightnessInstruction::execute(reg, cursor);
+        break;
+    case DisplayTextHexColorInstruction::OPCODE:
+        DisplayTextHexColorInstruction::execute(reg, cursor);
+        break;
+    case DisplayTextColorInstruction::OPCODE:
+        DisplayTextColorInstruction::execute(reg, cursor);
+        break;
+    case DisplayTextSizeInstruction::OPCODE:
+        DisplayTextSizeInstruction::execute(reg, cursor);
+        break;
+    case DisplayFillScreenInstruction::OPCODE:
+        DisplayFillScreenInstruction::execute(reg, cursor);
+        break;
+    case DisplayCursorInstruction::OPCODE:
+        DisplayCursorInstruction::execute(reg, cursor);
+        break;
+    case DelayInstruction::OPCODE:
+        DelayInstruction::execute(reg, cursor);
+        break;
+    case WriteRegisterInstruction::OPCODE:
+        WriteRegisterInstruction::execute(reg, cursor);
+        break;
+    case WriteFileInstruction::OPCODE:
+        WriteFileInstruction::execute(reg, cursor);
+        break;
+    case DisplayTextInstruction::OPCODE:
+        DisplayTextInstruction::execute(reg, cursor);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Compiles one command line into the program, returns false if it could not be parsed
+bool compileInstruction(Program &program, std::string_view instructionStr)
+{
+    size_t colonIndex = instructionStr.find(':');
+    if (colonIndex == std::string_view::npos)
     {
-        return new DelayInstruction(value);
+        LOG_WARN("Invalid instruction format: %.*s", (int)instructionStr.size(), instructionStr.data());
+        return false;
     }
-    else if (strcmp(command, WriteRegisterInstruction::NAME) == 0)
+
+    std::string_view command = trimView(instructionStr.substr(0, colonIndex));
+    std::string_view value = trimView(instructionStr.substr(colonIndex + 1));
+    LOG_DEBUG("Parsed command: %.*s, value: %.*s", (int)command.size(), command.data(), (int)value.size(), value.data());
+
+    if (!Instructions::compile(Instructions::find(command.data(), command.size()), program, value))
     {
-        return new WriteRegisterInstruction(value);
+        LOG_WARN("Unable to parse, instructions available:");
+        for (const char *name : Instructions::names)
+        {
+            LOG_WARN("  %s", name);
+        }
+        return false;
     }
-    else if (strcmp(command, WriteFileInstruction::NAME) == 0)
+    if (program.overflowed())
     {
-        return new WriteFileInstruction(value);
+        LOG_WARN("Program too large, %.*s does not fit", (int)instructionStr.size(), instructionStr.data());
+        return false;
     }
-
-    Serial.println(F("Unable to parse, instructions available:"));
-    Serial.println(ConsolePrintlnInstruction::NAME);
-    Serial.println(DisplayPrintlnInstruction::NAME);
-    Serial.println(DisplayBrightnessInstruction::NAME);
-    Serial.println(DisplayTextHexColorInstruction::NAME);
-    Serial.println(DisplayTextColorInstruction::NAME);
-    Serial.println(DisplayTextSizeInstruction::NAME);
-    Serial.println(DisplayFillScreenInstruction::NAME);
-    Serial.println(DisplayCursorInstruction::NAME);
-    Serial.println(DelayInstruction::NAME);
-    Serial.println(WriteRegisterInstruction::NAME);
-    Serial.println(WriteFileInstruction::NAME);
-    return nullptr;
+    return true;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,183 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <Arduino.h>
+#include <vector>
+#include "program.h"
+#include "instruction.h"
+
+#define OPTIMIZER_FILL_BYTES (TFT_WIDTH * TFT_HEIGHT * sizeof(uint16_t))
+
+struct OptimizerStats
+{
+    uint16_t before;
+    uint16_t after;
+    uint32_t spiBytes; // full screen fills that no longer reach the panel, 0 with a framebuffer: its flush only sends the final pixels
+};
+
+struct DecodedInstruction
+{
+    uint8_t opcode;
+    size_t offset; // of the first operand
+    bool dead;
+};
+
+// Anything that makes the text state or pixels observable, state changes are never dropped across it
+bool optimizerIsBarrier(uint8_t opcode)
+{
+    return opcode == DisplayPrintlnInstruction::OPCODE || opcode == DisplayTextInstruction::OPCODE ||
+           opcode == DelayInstruction::OPCODE; // other programs may draw while this one is suspended
+}
+
+bool optimizerIsTextState(uint8_t opcode)
+{
+    return opcode == DisplayTextHexColorInstruction::OPCODE || opcode == DisplayTextColorInstruction::OPCODE ||
+           opcode == DisplayTextSizeInstruction::OPCODE || opcode == DisplayCursorInstruction::OPCODE;
+}
+
+bool optimizerIsColor(uint8_t opcode)
+{
+    return opcode == DisplayTextHexColorInstruction::OPCODE || opcode == DisplayTextColorInstruction::OPCODE;
+}
+
+int16_t optimizerReadI16(const Program &program, size_t offset)
+{
+    return program.data()[offset] | (program.data()[offset + 1] << 8);
+}
+
+// True if `later` makes the effect of `earlier` unobservable, both must be of the same kind
+bool optimizerOverrides(const Program &program, const DecodedInstruction &earlier, const DecodedInstruction &later)
+{
+    switch (earlier.opcode)
+    {
+    case DisplayTextHexColorInstruction::OPCODE:
+    case DisplayTextColorInstruction::OPCODE:
+        return optimizerIsColor(later.opcode);
+    case DisplayTextSizeInstruction::OPCODE:
+    case DisplayFillScreenInstruction::OPCODE:
+    case DisplayBrightnessInstruction::OPCODE:
+        return later.opcode == earlier.opcode;
+    case DisplayCursorInstruction::OPCODE:
+        if (later.opcode != earlier.opcode)
+        {
+            return false;
+        }
+        // Each axis is only set if positive, the later one has to set every axis the earlier one did
+        return (optimizerReadI16(program, earlier.offset) <= 0 || optimizerReadI16(program, later.offset) > 0) &&
+               (optimizerReadI16(program, earlier.offset + 2) <= 0 || optimizerReadI16(program, later.offset + 2) > 0);
+    }
+    return false;
+}
+
+/**
+ * Peephole pass over a compiled program:
+ * - drops text color, size, cursor and brightness changes that are overwritten before anything uses them
+ * - drops fills that are painted over by another fill before any text or delay
+ * - fuses cursor/color/size changes directly followed by println into one display_text instruction
+ * State left at the end of a program is kept, the next program may rely on it.
+ */
+OptimizerStats optimizeProgram(Program &program)
+{
+    OptimizerStats stats = {program.count(), program.count(), 0};
+
+    std::vector<DecodedInstruction> decoded;
+    decoded.reserve(program.count());
+    for (size_t pc = 0; pc < program.size();)
+    {
+        uint8_t opcode = program.data()[pc];
+        if (opcode >= Instructions::SIZE)
+        {
+            return stats; // leave invalid programs to the VM
+        }
+        decoded.push_back({opcode, pc + 1, false});
+        pc += 1 + Instructions::operandBytes[opcode];
+    }
+
+    for (size_t i = 0; i < decoded.size(); i++)
+    {
+        DecodedInstruction &current = decoded[i];
+        bool candidate = optimizerIsTextState(current.opcode) || current.opcode == DisplayFillScreenInstruction::OPCODE ||
+                         current.opcode == DisplayBrightnessInstruction::OPCODE;
+        for (size_t j = i + 1; candidate && j < decoded.size(); j++)
+        {
+            // Brightness is not affected by text output, only a delay makes it visible
+            bool barrier = current.opcode == DisplayBrightnessInstruction::OPCODE ? decoded[j].opcode == DelayInstruction::OPCODE
+                                                                                  : optimizerIsBarrier(decoded[j].opcode);
+            if (barrier)
+            {
+                break;
+            }
+            if (optimizerOverrides(program, current, decoded[j]))
+            {
+                current.dead = true;
+                if (current.opcode == DisplayFillScreenInstruction::OPCODE && !display.isBuffered())
+                {
+                    stats.spiBytes += OPTIMIZER_FILL_BYTES;
+                }
+                break;
+            }
+        }
+    }
+
+    std::vector<uint8_t> code = program.takeCode();
+    const uint8_t *data = code.data();
+    for (size_t i = 0; i < decoded.size(); i++)
+    {
+        if (decoded[i].dead)
+        {
+            continue;
+        }
+
+        // Collect a run of live text state changes that ends in a println
+        size_t end = i;
+        while (end < decoded.size() && (decoded[end].dead || optimizerIsTextState(decoded[end].opcode)))
+        {
+            end++;
+        }
+        if (end > i && end < decoded.size() && decoded[end].opcode == DisplayPrintlnInstruction::OPCODE)
+        {
+            uint8_t flags = 0;
+            int16_t x = -1, y = -1;
+            uint16_t color = 0;
+            uint8_t size = 0;
+            for (size_t k = i; k < end; k++)
+            {
+                const DecodedInstruction &state = decoded[k];
+                const uint8_t *operands = data + state.offset;
+                if (state.dead)
+                {
+                    continue;
+                }
+                if (optimizerIsColor(state.opcode))
+                {
+                    flags |= DisplayTextInstruction::HAS_COLOR;
+                    color = operands[0] | (operands[1] << 8);
+                }
+                else if (state.opcode == DisplayTextSizeInstruction::OPCODE)
+                {
+                    flags |= DisplayTextInstruction::HAS_SIZE;
+                    size = operands[0];
+                }
+                else
+                {
+                    int16_t cx = operands[0] | (operands[1] << 8);
+                    int16_t cy = operands[2] | (operands[3] << 8);
+                    x = cx > 0 ? cx : x;
+                    y = cy > 0 ? cy : y;
+                }
+            }
+            const uint8_t *text = data + decoded[end].offset;
+            DisplayTextInstruction::emit(program, flags, x, y, color, size, text[0] | (text[1] << 8));
+            i = end;
+            continue;
+        }
+
+        program.emitOpcode(decoded[i].opcode);
+        program.emitBytes(data + decoded[i].offset, Instructions::operandBytes[decoded[i].opcode]);
+    }
+
+    stats.after = program.count();
+    return stats;
+}
+
+#endif
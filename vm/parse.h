@@ -0,0 +1,109 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <Arduino.h>
+#include <string_view>
+
+// Allocation free helpers for command parsing, all of them work on views into the request body
+
+std::string_view trimView(std::string_view str)
+{
+    while (!str.empty() && isspace((unsigned char)str.front()))
+    {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && isspace((unsigned char)str.back()))
+    {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// Same rules as String::toInt(): optional sign, digits until the first other character, 0 if none
+long parseInt(std::string_view str)
+{
+    str = trimView(str);
+    bool negative = false;
+    if (!str.empty() && (str.front() == '-' || str.front() == '+'))
+    {
+        negative = str.front() == '-';
+        str.remove_prefix(1);
+    }
+    long value = 0;
+    for (char c : str)
+    {
+        if (c < '0' || c > '9')
+        {
+            break;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return negative ? -value : value;
+}
+
+// Accepts an optional "0x" or "#" prefix, stops at the first non hex character
+uint32_t parseHex(std::string_view str)
+{
+    str = trimView(str);
+    if (str.size() > 1 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+        str.remove_prefix(2);
+    }
+    else if (!str.empty() && str[0] == '#')
+    {
+        str.remove_prefix(1);
+    }
+    uint32_t value = 0;
+    for (char c : str)
+    {
+        uint8_t digit;
+        if (c >= '0' && c <= '9')
+        {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            digit = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            digit = c - 'A' + 10;
+        }
+        else
+        {
+            break;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+// Splits "x,y", returns false if there is no comma
+bool parseCoordinates(std::string_view str, long &x, long &y)
+{
+    size_t comma = str.find(',');
+    if (comma == std::string_view::npos)
+    {
+        return false;
+    }
+    x = parseInt(str.substr(0, comma));
+    y = parseInt(str.substr(comma + 1));
+    return true;
+}
+
+// Calls back with a view for every part, the views are only valid as long as `str` is
+template <typename Callback>
+void splitView(std::string_view str, char delimiter, Callback callback)
+{
+    size_t start = 0;
+    size_t end = str.find(delimiter);
+    while (end != std::string_view::npos)
+    {
+        callback(str.substr(start, end - start));
+        start = end + 1;
+        end = str.find(delimiter, start);
+    }
+    callback(str.substr(start));
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "instruction.h"
+
+#define PROFILER_BUCKETS 16 // bucket i counts samples below 2^i us, the last one everything above
+
+struct LatencyStats
+{
+    uint32_t count;
+    uint64_t totalUs;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t histogram[PROFILER_BUCKETS];
+
+    void record(uint32_t us)
+    {
+        minUs = count == 0 || us < minUs ? us : minUs;
+        maxUs = us > maxUs ? us : maxUs;
+        count++;
+        totalUs += us;
+        uint8_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+        histogram[bucket < PROFILER_BUCKETS ? bucket : PROFILER_BUCKETS - 1]++;
+    }
+
+    void merge(const LatencyStats &other)
+    {
+        if (other.count == 0)
+        {
+            return;
+        }
+        minUs = count == 0 || other.minUs < minUs ? other.minUs : minUs;
+        maxUs = other.maxUs > maxUs ? other.maxUs : maxUs;
+        count += other.count;
+        totalUs += other.totalUs;
+        for (uint8_t i = 0; i < PROFILER_BUCKETS; i++)
+        {
+            histogram[i] += other.histogram[i];
+        }
+    }
+
+    void appendJson(String &out) const
+    {
+        out += "{\"count\":" + String(count);
+        out += ",\"total_us\":" + String((unsigned long long)totalUs);
+        out += ",\"min_us\":" + String(minUs);
+        out += ",\"max_us\":" + String(maxUs);
+        out += ",\"histogram\":[";
+        for (uint8_t i = 0; i < PROFILER_BUCKETS; i++)
+        {
+            out += i ? "," : "";
+            out += String(histogram[i]);
+        }
+        out += "]}";
+    }
+};
+
+/**
+ * Execution times per opcode, time programs spent queued and display flush times.
+ * Written by loop(), read by the web server, both sides copy under a short critical section.
+ * Instruction times are collected without the lock and published once per run of a program, see publish().
+ */
+class Profiler
+{
+private:
+    struct Stats
+    {
+        LatencyStats instructions[Instructions::SIZE];
+        LatencyStats queueWait;
+        LatencyStats flush;
+    } stats;
+    LatencyStats pending[Instructions::SIZE]; // loop() only, not yet in stats
+    uint32_t cyclesPerUs;
+    mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+    void record(LatencyStats &target, int64_t us)
+    {
+        portENTER_CRITICAL(&lock);
+        target.record(us > 0 ? us : 0);
+        portEXIT_CRITICAL(&lock);
+    }
+
+public:
+    Profiler()
+    {
+        memset(&stats, 0, sizeof(stats));
+        memset(pending, 0, sizeof(pending));
+        cyclesPerUs = ESP.getCpuFreqMHz();
+    }
+
+    static int64_t now()
+    {
+        return esp_timer_get_time();
+    }
+
+    // For instruction times: a register read, where esp_timer_get_time() takes a lock. Wraps after 2^32 cycles,
+    // about 18 s at 240 MHz, an instruction that waits longer suspends the program instead.
+    static uint32_t cycles()
+    {
+        return ESP.getCycleCount();
+    }
+
+    // Visible to appendJson() after the next publish()
+    void recordInstruction(uint8_t opcode, uint32_t cycles)
+    {
+        if (opcode < Instructions::SIZE)
+        {
+            pending[opcode].record(cycles / cyclesPerUs);
+        }
+    }
+    void publish()
+    {
+        portENTER_CRITICAL(&lock);
+        for (uint8_t opcode = 0; opcode < Instructions::SIZE; opcode++)
+        {
+            stats.instructions[opcode].merge(pending[opcode]);
+        }
+        portEXIT_CRITICAL(&lock);
+        memset(pending, 0, sizeof(pending));
+    }
+    void recordQueueWait(int64_t us) { record(stats.queueWait, us); }
+    void recordFlush(int64_t us) { record(stats.flush, us); }
+
+    void reset()
+    {
+        portENTER_CRITICAL(&lock);
+        memset(&stats, 0, sizeof(stats));
+        portEXIT_CRITICAL(&lock);
+    }
+
+    // Opcodes that never ran are left out
+    void appendJson(String &out) const
+    {
+        Stats snapshot;
+        portENTER_CRITICAL(&lock);
+        snapshot = stats;
+        portEXIT_CRITICAL(&lock);
+
+        out += "{\"histogram_buckets_us\":[";
+        for (uint8_t i = 0; i < PROFILER_BUCKETS - 1; i++)
+        {
+            out += String(1u << i) + ",";
+        }
+        out += "null],\"instructions\":{";
+        bool first = true;
+        for (uint8_t opcode = 0; opcode < Instructions::SIZE; opcode++)
+        {
+            if (snapshot.instructions[opcode].count == 0)
+            {
+                continue;
+            }
+            out += first ? "\"" : ",\"";
+            out += Instructions::name(opcode);
+            out += "\":";
+            snapshot.instructions[opcode].appendJson(out);
+            first = false;
+        }
+        out += "},\"queue_wait\":";
+        snapshot.queueWait.appendJson(out);
+        out += ",\"flush\":";
+        snapshot.flush.appendJson(out);
+        out += "}";
+    }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <Arduino.h>
+#include <vector>
+
+// Operands and the instruction count are 16 bit, a batch that needs more is refused instead of wrapping
+#define PROGRAM_MAX_INSTRUCTIONS 0xFFFF
+#define PROGRAM_MAX_POOL 0xFFFF // bytes of strings including their terminators
+
+/**
+ * A compiled command batch: opcodes followed by their inline operands (little endian).
+ * String operands are stored once in a side pool and referenced by their offset.
+ */
+class Program
+{
+private:
+    std::vector<uint8_t> code;
+    std::vector<char> pool;
+    std::vector<uint16_t> strings; // open addressing index into the pool, offset + 1, 0 marks a free slot
+    uint16_t stringCount;
+    uint16_t instructions;
+    bool overflow;
+    int64_t queuedAt;
+    uint32_t sourceId;
+    uint32_t batchId;
+
+    // FNV-1a, only used to find duplicate strings
+    static uint32_t hash(const char *value, size_t length)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            h = (h ^ (uint8_t)value[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    // Keeps the index at most half full
+    void growIndex()
+    {
+        std::vector<uint16_t> old;
+        old.swap(strings);
+        strings.assign(old.empty() ? 16 : old.size() * 2, 0);
+        for (uint16_t slot : old)
+        {
+            if (slot != 0)
+            {
+                const char *value = &pool[slot - 1];
+                size_t mask = strings.size() - 1;
+                size_t i = hash(value, strlen(value)) & mask;
+                while (strings[i] != 0)
+                {
+                    i = (i + 1) & mask;
+                }
+                strings[i] = slot;
+            }
+        }
+    }
+
+public:
+    Program() : stringCount(0), instructions(0), overflow(false), queuedAt(0), sourceId(0), batchId(0) {}
+
+    // Sizes the buffers for a script of the given length so compiling rarely reallocates
+    void reserve(size_t sourceLength)
+    {
+        code.reserve(sourceLength / 4 + 16);
+        pool.reserve(sourceLength);
+    }
+
+    void emitOpcode(uint8_t opcode)
+    {
+        if (instructions == PROGRAM_MAX_INSTRUCTIONS)
+        {
+            overflow = true;
+            return;
+        }
+        code.push_back(opcode);
+        instructions++;
+    }
+    void emit8(uint8_t value)
+    {
+        code.push_back(value);
+    }
+    void emit16(uint16_t value)
+    {
+        code.push_back(value & 0xFF);
+        code.push_back(value >> 8);
+    }
+    void emit32(uint32_t value)
+    {
+        emit16(value & 0xFFFF);
+        emit16(value >> 16);
+    }
+    void emitBytes(const uint8_t *bytes, size_t length)
+    {
+        code.insert(code.end(), bytes, bytes + length);
+    }
+    void emitString(const char *value, size_t length)
+    {
+        emit16(intern(value, length));
+    }
+
+    // Offset of the string in the pool, equal strings are stored once. Sets overflowed() once the pool is full.
+    uint16_t intern(const char *value, size_t length)
+    {
+        if (stringCount * 2 >= strings.size())
+        {
+            growIndex();
+        }
+        size_t mask = strings.size() - 1;
+        size_t i = hash(value, length) & mask;
+        for (; strings[i] != 0; i = (i + 1) & mask)
+        {
+            const char *candidate = &pool[strings[i] - 1];
+            if (strncmp(candidate, value, length) == 0 && candidate[length] == '\0')
+            {
+                return strings[i] - 1;
+            }
+        }
+        if (pool.size() + length + 1 > PROGRAM_MAX_POOL)
+        {
+            overflow = true;
+            return 0;
+        }
+        uint16_t offset = pool.size();
+        pool.insert(pool.end(), value, value + length);
+        pool.push_back('\0');
+        strings[i] = offset + 1;
+        stringCount++;
+        return offset;
+    }
+
+    // Hands out the code so it can be emitted again, the string pool stays valid
+    std::vector<uint8_t> takeCode()
+    {
+        std::vector<uint8_t> taken;
+        taken.swap(code);
+        instructions = 0;
+        return taken;
+    }
+
+    // esp_timer time at which the program entered the VM queue
+    void markQueued(int64_t us) { queuedAt = us; }
+    int64_t queuedTime() const { return queuedAt; }
+
+    // Who submitted the program, handed back when it completed. Source 0 is the HTTP /command route.
+    void tag(uint32_t source, uint32_t batch)
+    {
+        sourceId = source;
+        batchId = batch;
+    }
+    uint32_t source() const { return sourceId; }
+    uint32_t batch() const { return batchId; }
+
+    const uint8_t *data() const { return code.data(); }
+    size_t size() const { return code.size(); }
+    size_t poolSize() const { return pool.size(); }
+    uint16_t count() const { return instructions; }
+    bool isEmpty() const { return code.empty(); }
+    // More instructions or string bytes were emitted than the 16 bit operands address, the program must not run
+    bool overflowed() const { return overflow; }
+    const char *string(uint16_t offset) const { return &pool[offset]; }
+};
+
+// Reads operands while the VM walks a program, instructions may ask to suspend the program
+class ProgramCursor
+{
+private:
+    const Program &program;
+    size_t pc;
+    uint32_t sleepMs;
+
+public:
+    ProgramCursor(const Program &program, size_t pc = 0) : program(program), pc(pc), sleepMs(0) {}
+
+    bool atEnd() const { return pc >= program.size(); }
+    size_t position() const { return pc; }
+
+    // Suspends the program after the current instruction, the VM resumes it once the time passed
+    void sleep(uint32_t ms)
+    {
+        sleepMs = ms;
+    }
+    uint32_t takeSleep()
+    {
+        uint32_t ms = sleepMs;
+        sleepMs = 0;
+        return ms;
+    }
+
+    uint8_t u8()
+    {
+        return program.data()[pc++];
+    }
+    uint16_t u16()
+    {
+        uint16_t value = program.data()[pc] | (program.data()[pc + 1] << 8);
+        pc += 2;
+        return value;
+    }
+    uint32_t u32()
+    {
+        uint32_t low = u16();
+        return low | ((uint32_t)u16() << 16);
+    }
+    const char *string()
+    {
+        return program.string(u16());
+    }
+};
+
+#endif
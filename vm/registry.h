@@ -0,0 +1,134 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <Arduino.h>
+#include <array>
+#include <string_view>
+#include "program.h"
+
+typedef void (*CompileFunction)(Program &program, std::string_view value);
+
+constexpr size_t constLength(const char *str)
+{
+    size_t length = 0;
+    while (str[length])
+    {
+        length++;
+    }
+    return length;
+}
+
+// FNV-1a with a seed, the seed is chosen at compile time so that no two names share a slot
+constexpr uint32_t opcodeHash(const char *str, size_t length, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr size_t hashSlots(size_t count)
+{
+    size_t slots = 1;
+    while (slots < 2 * count)
+    {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+#define REGISTRY_EMPTY_SLOT 0xFF
+
+template <size_t SLOTS>
+struct PerfectHash
+{
+    uint32_t seed;
+    std::array<uint8_t, SLOTS> slots; // index into the instruction list or REGISTRY_EMPTY_SLOT
+};
+
+template <size_t COUNT, size_t SLOTS>
+constexpr PerfectHash<SLOTS> buildPerfectHash(const std::array<const char *, COUNT> &names)
+{
+    for (uint32_t seed = 0;; seed++)
+    {
+        PerfectHash<SLOTS> table{seed, {}};
+        for (size_t i = 0; i < SLOTS; i++)
+        {
+            table.slots[i] = REGISTRY_EMPTY_SLOT;
+        }
+        bool collision = false;
+        for (size_t i = 0; i < COUNT && !collision; i++)
+        {
+            size_t slot = opcodeHash(names[i], constLength(names[i]), seed) & (SLOTS - 1);
+            collision = table.slots[slot] != REGISTRY_EMPTY_SLOT;
+            table.slots[slot] = i;
+        }
+        if (!collision)
+        {
+            return table;
+        }
+    }
+}
+
+/**
+ * Compile time table over all instructions, built from their NAME, OPCODE, OPERAND_BYTES and compile().
+ * Opcodes must equal the position in the list so they can be used as an index.
+ */
+template <typename... Instructions>
+class InstructionTable
+{
+public:
+    static constexpr size_t SIZE = sizeof...(Instructions);
+    static constexpr size_t SLOTS = hashSlots(SIZE);
+    static constexpr std::array<const char *, SIZE> names = {Instructions::NAME...};
+    static constexpr std::array<uint8_t, SIZE> opcodes = {Instructions::OPCODE...};
+    static constexpr std::array<CompileFunction, SIZE> compilers = {&Instructions::compile...};
+    static constexpr std::array<uint8_t, SIZE> operandBytes = {Instructions::OPERAND_BYTES...};
+    static constexpr PerfectHash<SLOTS> hash = buildPerfectHash<SIZE, SLOTS>(names);
+
+    static_assert(SIZE < REGISTRY_EMPTY_SLOT, "Too many instructions for the opcode table");
+
+    static constexpr bool opcodesMatchPositions()
+    {
+        for (size_t i = 0; i < SIZE; i++)
+        {
+            if (opcodes[i] != i)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(opcodesMatchPositions(), "Instruction opcodes must be listed in order");
+
+    // Returns the opcode for the command name or REGISTRY_EMPTY_SLOT
+    static uint8_t find(const char *command, size_t length)
+    {
+        uint8_t index = hash.slots[opcodeHash(command, length, hash.seed) & (SLOTS - 1)];
+        if (index == REGISTRY_EMPTY_SLOT || strncmp(names[index], command, length) != 0 || names[index][length] != '\0')
+        {
+            return REGISTRY_EMPTY_SLOT;
+        }
+        return index;
+    }
+
+    static const char *name(uint8_t opcode)
+    {
+        return opcode < SIZE ? names[opcode] : "unknown";
+    }
+
+    static bool compile(uint8_t opcode, Program &program, std::string_view value)
+    {
+        if (opcode >= SIZE)
+        {
+            return false;
+        }
+        compilers[opcode](program, value);
+        return true;
+    }
+};
+
+#endif
@@ -1,51 +1,171 @@
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
+#include <Arduino.h>
+#include <atomic>
 #include <memory>
-#include "instruction.h"
+#include "program.h"
 
 #define VM_COMMAND_BUFFER_SIZE 100
+#define VM_CACHE_LINE 64
+#define VM_QUEUE_BLOCK_MS 1000 // longest time a producer waits for space with OverflowPolicy::BLOCK
 
-template <typename T>
+enum class OverflowPolicy
+{
+    DROP_OLDEST, // evict the oldest entry, pop() and the eviction share a short critical section
+    REJECT_NEW,  // push() fails and the caller decides, lock-free
+    BLOCK,       // push() waits up to VM_QUEUE_BLOCK_MS for the consumer, then fails, lock-free
+};
+
+/**
+ * Single producer / single consumer queue holding up to CAPACITY entries.
+ * Only the producer (the web server task) writes head, only the consumer (loop()) writes tail,
+ * each index sits on its own cache line so the two cores do not invalidate each other.
+ */
+template <typename T, size_t CAPACITY = VM_COMMAND_BUFFER_SIZE, OverflowPolicy POLICY = OverflowPolicy::REJECT_NEW>
 class RingBuffer
 {
 private:
-    std::unique_ptr<T> buffer[VM_COMMAND_BUFFER_SIZE];
-    int head;
-    int tail;
+    static constexpr size_t SLOTS = CAPACITY + 1; // one slot stays empty to tell full from empty
+
+    std::unique_ptr<T> buffer[SLOTS];
+    alignas(VM_CACHE_LINE) std::atomic<size_t> head;
+    alignas(VM_CACHE_LINE) std::atomic<size_t> tail;
+    alignas(VM_CACHE_LINE) std::atomic<TaskHandle_t> consumer;
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+    std::atomic<uint32_t> pushed;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> highWater;
+
+    bool full(size_t h) const
+    {
+        return (h + 1) % SLOTS == tail.load(std::memory_order_acquire);
+    }
+
+    void notifyConsumer()
+    {
+        TaskHandle_t task = consumer.load(std::memory_order_acquire);
+        if (task)
+        {
+            xTaskNotifyGive(task);
+        }
+    }
 
 public:
-    RingBuffer() : head(0), tail(0) {}
+    RingBuffer() : head(0), tail(0), consumer(nullptr), pushed(0), dropped(0), highWater(0) {}
+
+    static constexpr size_t capacity() { return CAPACITY; }
+    static constexpr OverflowPolicy policy() { return POLICY; }
 
     bool isEmpty() const
     {
-        return head == tail;
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
     }
     bool isFull() const
     {
-        return (head + 1) % VM_COMMAND_BUFFER_SIZE == tail;
+        return full(head.load(std::memory_order_acquire));
+    }
+    size_t size() const
+    {
+        return (head.load(std::memory_order_acquire) + SLOTS - tail.load(std::memory_order_acquire)) % SLOTS;
     }
 
-    void push(std::unique_ptr<T> value)
+    uint32_t pushCount() const { return pushed.load(std::memory_order_relaxed); }
+    // Entries rejected, evicted or timed out, depending on the policy
+    uint32_t dropCount() const { return dropped.load(std::memory_order_relaxed); }
+    uint32_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+
+    // Producer side, returns false if the value was not queued
+    bool push(std::unique_ptr<T> value)
     {
-        buffer[head] = std::move(value);
-        head = (head + 1) % VM_COMMAND_BUFFER_SIZE;
-        if (head == tail)
+        size_t h = head.load(std::memory_order_relaxed);
+        std::unique_ptr<T> evicted;
+
+        if (POLICY == OverflowPolicy::BLOCK)
         {
-            tail = (tail + 1) % VM_COMMAND_BUFFER_SIZE;
+            for (uint32_t waited = 0; full(h) && waited < VM_QUEUE_BLOCK_MS; waited += 5)
+            {
+                vTaskDelay(pdMS_TO_TICKS(5));
+            }
         }
+
+        if (POLICY == OverflowPolicy::DROP_OLDEST)
+        {
+            portENTER_CRITICAL(&lock);
+            if (full(h))
+            {
+                size_t t = tail.load(std::memory_order_relaxed);
+                evicted = std::move(buffer[t]);
+                tail.store((t + 1) % SLOTS, std::memory_order_release);
+            }
+            buffer[h] = std::move(value);
+            head.store((h + 1) % SLOTS, std::memory_order_release);
+            portEXIT_CRITICAL(&lock);
+
+            if (evicted)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            if (full(h))
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            buffer[h] = std::move(value);
+            head.store((h + 1) % SLOTS, std::memory_order_release);
+        }
+
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        uint32_t depth = size();
+        if (depth > highWater.load(std::memory_order_relaxed))
+        {
+            highWater.store(depth, std::memory_order_relaxed);
+        }
+        notifyConsumer();
+        return true;
     }
 
+    // Consumer side
     std::unique_ptr<T> pop()
     {
-        if (head == tail)
+        std::unique_ptr<T> value;
+        if (POLICY == OverflowPolicy::DROP_OLDEST)
         {
-            return nullptr;
+            portENTER_CRITICAL(&lock);
+        }
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t != head.load(std::memory_order_acquire))
+        {
+            value = std::move(buffer[t]);
+            tail.store((t + 1) % SLOTS, std::memory_order_release);
+        }
+        if (POLICY == OverflowPolicy::DROP_OLDEST)
+        {
+            portEXIT_CRITICAL(&lock);
         }
-        std::unique_ptr<T> value = std::move(buffer[tail]);
-        tail = (tail + 1) % VM_COMMAND_BUFFER_SIZE;
         return value;
     }
+
+    // Registers the calling task as consumer, push() notifies it from then on
+    void attachConsumer()
+    {
+        consumer.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+    }
+
+    // Blocks the consumer until something was pushed or the timeout passed, returns true if there is work
+    bool wait(uint32_t timeout_ms)
+    {
+        if (!isEmpty())
+        {
+            return true;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+        return !isEmpty();
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
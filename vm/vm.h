@@ -2,15 +2,50 @@
 #define VM_H_
 
 #include <Arduino.h>
+#include "../lib_log.h"
 #include "register.h"
+#include "program.h"
 #include "ringbuffer.h"
 #include "instruction.h"
+#include "optimizer.h"
+#include "profiler.h"
+
+#define VM_QUEUE_POLICY OverflowPolicy::REJECT_NEW
+#define VM_CONTEXTS 4 // programs that can be suspended in a delay at the same time
+
+// A program in execution, resumed at pc once wakeAt (millis) has passed
+struct VMContext
+{
+    std::unique_ptr<Program> program;
+    size_t pc;
+    uint32_t wakeAt;
+    uint32_t startedAt;
+    uint32_t queueWaitUs;
+    uint16_t executed;
+};
+
+struct ProgramResult
+{
+    uint32_t source;
+    uint32_t batch;
+    uint16_t instructions; // after optimization
+    uint16_t executed;
+    bool aborted; // invalid opcode
+    uint32_t queueWaitUs;
+    uint32_t durationMs; // from the first instruction, including delays
+};
+typedef void (*ProgramListener)(const ProgramResult &result);
 
 class VM
 {
 protected:
     Register reg;
-    RingBuffer<Instruction> instructions;
+    RingBuffer<Program, VM_COMMAND_BUFFER_SIZE, VM_QUEUE_POLICY> programs;
+    VMContext contexts[VM_CONTEXTS];
+    uint32_t optimizedInstructions = 0;
+    uint32_t optimizedSpiBytes = 0;
+    Profiler profiler;
+    ProgramListener listener = nullptr;
 
 public:
     VM()
@@ -18,39 +53,203 @@ public:
         init();
     };
 
-    void queue(std::unique_ptr<Instruction> instruction)
+    // Must be called from the task that calls run()
+    void begin()
     {
-        if (instruction)
+        programs.attachConsumer();
+    }
+
+    // Called from the web server task, returns false if the program was dropped
+    bool queue(std::unique_ptr<Program> program)
+    {
+        if (!program || program->isEmpty())
+        {
+            LOG_WARN("Received empty program");
+            return false;
+        }
+        if (program->overflowed())
         {
-            instructions.push(std::move(instruction));
+            LOG_WARN("Program exceeds %u instructions or %u bytes of strings, dropping it", PROGRAM_MAX_INSTRUCTIONS, PROGRAM_MAX_POOL);
+            return false;
         }
-        else
+        program->markQueued(Profiler::now());
+        if (!programs.push(std::move(program)))
         {
-            Serial.println(F("Received null instruction"));
+            LOG_WARN("VM queue full (%u programs), dropping program", programs.size());
+            return false;
         }
+        return true;
     }
 
-    void run()
+    size_t queueDepth() const { return programs.size(); }
+    size_t queueCapacity() const { return programs.capacity(); }
+    uint32_t queueDrops() const { return programs.dropCount(); }
+    uint32_t queuePushes() const { return programs.pushCount(); }
+    uint32_t queueHighWater() const { return programs.highWaterMark(); }
+    uint32_t optimizerInstructionsRemoved() const { return optimizedInstructions; }
+    uint32_t optimizerSpiBytesSaved() const { return optimizedSpiBytes; }
+    Profiler &stats() { return profiler; }
+
+    // Called from loop() whenever a program completed or was aborted
+    void onComplete(ProgramListener callback)
+    {
+        listener = callback;
+    }
+
+    // Sleeps until a program was queued or the timeout passed, returns true if there is work
+    bool waitForWork(uint32_t timeout_ms)
     {
-        Serial.println(F("Running VM..."));
-        while (!instructions.isEmpty())
+        if (!freeContext())
         {
-            std::unique_ptr<Instruction> instruction = instructions.pop();
-            if (instruction)
+            // Queued programs cannot start before a running one finishes
+            vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+            return false;
+        }
+        return programs.wait(timeout_ms);
+    }
+
+    // True if no program is running or suspended
+    bool isIdle() const
+    {
+        for (const VMContext &context : contexts)
+        {
+            if (context.program)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Milliseconds until the next suspended program resumes, UINT32_MAX if there is none
+    uint32_t nextWakeIn() const
+    {
+        uint32_t now = millis();
+        uint32_t next = UINT32_MAX;
+        for (const VMContext &context : contexts)
+        {
+            if (context.program)
             {
-                Serial.printf(F("Executing instruction: %s\n"), instruction->name());
-                instruction->execute(reg);
+                int32_t remaining = context.wakeAt - now;
+                next = min<uint32_t>(next, remaining > 0 ? remaining : 0);
             }
         }
-        Serial.println(F("VM run completed"));
+        return next;
+    }
+
+    // Runs every ready program until it finished or suspended itself, never blocks on a delay
+    void run()
+    {
+        DisplayLock lock;
+        bool progressed;
+        do
+        {
+            progressed = false;
+            admit();
+            for (VMContext &context : contexts)
+            {
+                if (context.program && (int32_t)(millis() - context.wakeAt) >= 0)
+                {
+                    resume(context);
+                    progressed = true;
+                }
+            }
+        } while (progressed);
+        flush();
     }
 
 private:
+    void flush()
+    {
+        int64_t start = Profiler::now();
+        if (display.flushDamage() > 0)
+        {
+            profiler.recordFlush(Profiler::now() - start);
+        }
+    }
+
+    VMContext *freeContext()
+    {
+        for (VMContext &context : contexts)
+        {
+            if (!context.program)
+            {
+                return &context;
+            }
+        }
+        return nullptr;
+    }
+
+    void admit()
+    {
+        VMContext *context;
+        while (!programs.isEmpty() && (context = freeContext()))
+        {
+            context->program = programs.pop();
+            context->queueWaitUs = Profiler::now() - context->program->queuedTime();
+            profiler.recordQueueWait(context->queueWaitUs);
+            OptimizerStats stats = optimizeProgram(*context->program);
+            if (stats.after < stats.before)
+            {
+                optimizedInstructions += stats.before - stats.after;
+                optimizedSpiBytes += stats.spiBytes;
+                LOG_DEBUG("Optimized program: %u -> %u instructions, %u SPI bytes saved", stats.before, stats.after, stats.spiBytes);
+            }
+            context->pc = 0;
+            context->wakeAt = millis();
+            context->startedAt = millis();
+            context->executed = 0;
+            LOG_INFO("Executing program: %u instructions, %u bytes code, %u bytes strings", context->program->count(), context->program->size(), context->program->poolSize());
+        }
+    }
+
+    void resume(VMContext &context)
+    {
+        ProgramCursor cursor(*context.program, context.pc);
+        bool aborted = false;
+        // One clock read per instruction, where one ends the next starts
+        uint32_t start = Profiler::cycles();
+        while (!cursor.atEnd())
+        {
+            uint8_t opcode = context.program->data()[cursor.position()];
+            if (!executeInstruction(reg, cursor))
+            {
+                LOG_ERROR("Invalid opcode at %u, aborting program", cursor.position() - 1);
+                aborted = true;
+                break;
+            }
+            context.executed++;
+            uint32_t end = Profiler::cycles();
+            profiler.recordInstruction(opcode, end - start);
+            start = end;
+            uint32_t sleepMs = cursor.takeSleep();
+            if (sleepMs > 0)
+            {
+                profiler.publish();
+                context.pc = cursor.position();
+                context.wakeAt = millis() + sleepMs;
+                flush(); // show what was drawn before the delay
+                return;
+            }
+        }
+        profiler.publish();
+        uint32_t duration = millis() - context.startedAt;
+        LOG_INFO("Program completed in %lums", duration);
+        if (listener)
+        {
+            const Program &program = *context.program;
+            listener({program.source(), program.batch(), program.count(), context.executed, aborted, context.queueWaitUs, duration});
+        }
+        context.program.reset();
+    }
+
     void init()
     {
-        instructions.push(std::make_unique<ConsolePrintlnInstruction>("VM initialized"));
-        instructions.push(std::make_unique<DisplayPrintlnInstruction>("VM initialized"));
-        instructions.push(std::make_unique<DelayInstruction>("1000"));
+        std::unique_ptr<Program> program(new Program());
+        ConsolePrintlnInstruction::compile(*program, "VM initialized");
+        DisplayPrintlnInstruction::compile(*program, "VM initialized");
+        program->markQueued(Profiler::now());
+        programs.push(std::move(program));
     }
 };
 